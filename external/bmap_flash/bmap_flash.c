@@ -0,0 +1,632 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * bmap_flash - create a block map for a sparse disk image and flash only
+ * the mapped ranges of it.
+ *
+ * The release images are mostly empty: the GPT, the loader/uboot/trust/boot
+ * blobs and the allocated part of the rootfs ext4 are the only data. The map
+ * is built from the layout, never from the contents: everything outside an
+ * ext4 partition is mapped, and inside an ext4 partition only the blocks
+ * marked free in the block bitmaps (as read by dumpe2fs from e2fsprogs) are
+ * left out. Allocated blocks that happen to hold zeroes are still written,
+ * so stale data on a reused card can never show through.
+ *
+ * Usage:
+ *	bmap_flash --create IMAGE [BMAP]
+ *	bmap_flash [--no-direct] IMAGE BMAP DEVICE
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <linux/fs.h>
+
+#define LOGE(fmt, args...)                                                     \
+  fprintf(stderr, "E/%s(%d): " fmt "\n", __func__, __LINE__, ##args)
+
+#define BMAP_VERSION "1.4"
+#define BMAP_BLOCK_SIZE 4096
+/* bytes, size of a single read/write request while flashing. */
+#define CHUNK_SIZE (4 << 20)
+/*
+ * bytes, alignment of the O_DIRECT buffer, offsets and lengths. Parts of
+ * a range that are not aligned are written through the page cache.
+ */
+#define DIRECT_ALIGN 4096
+
+typedef struct {
+	uint64_t first; /* blocks, first mapped block. */
+	uint64_t last;  /* blocks, last mapped block (inclusive). */
+} bmap_range;
+
+typedef struct {
+	uint64_t image_size; /* bytes */
+	uint32_t block_size; /* bytes */
+	uint64_t blocks;
+	uint64_t mapped_blocks;
+	bmap_range *ranges;
+	int range_num;
+	int range_max;
+} bmap;
+
+static const char *PROG = "bmap_flash";
+
+static void usage(void)
+{
+	printf("Usage:\n");
+	printf("\t%s --create IMAGE [BMAP]\n", PROG);
+	printf("\t\tMap IMAGE from its GPT and ext4 block bitmaps (default IMAGE.bmap).\n");
+	printf("\t%s [--no-direct] IMAGE BMAP DEVICE\n", PROG);
+	printf("\t\tWrite the ranges listed in BMAP from IMAGE to DEVICE.\n");
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static bool add_range(bmap *map, uint64_t first, uint64_t last)
+{
+	if (map->range_num) {
+		/* widened extents may overlap the previous range. */
+		uint64_t prev = map->ranges[map->range_num - 1].last;
+
+		if (last <= prev)
+			return true;
+		if (first <= prev)
+			first = prev + 1;
+	}
+	if (map->range_num &&
+	    map->ranges[map->range_num - 1].last + 1 == first) {
+		map->ranges[map->range_num - 1].last = last;
+		goto done;
+	}
+	if (map->range_num == map->range_max) {
+		int max = map->range_max ? map->range_max * 2 : 64;
+		bmap_range *ranges = realloc(map->ranges, max * sizeof(*ranges));
+
+		if (!ranges)
+			return false;
+		map->ranges = ranges;
+		map->range_max = max;
+	}
+	map->ranges[map->range_num].first = first;
+	map->ranges[map->range_num].last = last;
+	map->range_num++;
+done:
+	map->mapped_blocks += last - first + 1;
+	return true;
+}
+
+/* byte range [start, end) of the image that never needs to be written. */
+typedef struct {
+	uint64_t start;
+	uint64_t end;
+} extent;
+
+typedef struct {
+	extent *list;
+	int num;
+	int max;
+} extent_list;
+
+#define GPT_SIGNATURE "EFI PART"
+#define SECTOR_SIZE 512
+#define EXT4_SB_OFFSET 1024
+#define EXT4_SB_MAGIC_OFFSET 0x38
+#define EXT4_SB_MAGIC 0xEF53
+
+static bool add_extent(extent_list *unused, uint64_t start, uint64_t end)
+{
+	if (unused->num == unused->max) {
+		int max = unused->max ? unused->max * 2 : 64;
+		extent *list = realloc(unused->list, max * sizeof(*list));
+
+		if (!list)
+			return false;
+		unused->list = list;
+		unused->max = max;
+	}
+	unused->list[unused->num].start = start;
+	unused->list[unused->num].end = end;
+	unused->num++;
+	return true;
+}
+
+static int cmp_extent(const void *a, const void *b)
+{
+	const extent *x = a, *y = b;
+
+	if (x->start != y->start)
+		return x->start < y->start ? -1 : 1;
+	return 0;
+}
+
+static uint64_t get_le(const uint8_t *p, int len)
+{
+	uint64_t val = 0;
+
+	while (len--)
+		val = (val << 8) | p[len];
+	return val;
+}
+
+/*
+ * Add the free blocks of the ext4 filesystem at @offset to @unused. The
+ * bitmaps are read through dumpe2fs, which also works out the blocks used
+ * in groups whose bitmap is still uninitialised (BLOCK_UNINIT).
+ */
+static bool ext4_free_blocks(const char *image_path, uint64_t offset,
+			     extent_list *unused)
+{
+	char cmd[8192], line[4096];
+	uint64_t block_size = 0;
+	bool ret = false;
+	FILE *pipe;
+	char *p;
+	int len;
+
+	/* dumpe2fs takes "file?offset=N"; quote the path for the shell. */
+	len = snprintf(cmd, sizeof(cmd), "dumpe2fs '");
+	for (p = (char *)image_path; *p && len < (int)sizeof(cmd) - 64; p++) {
+		if (*p == '\'')
+			len += snprintf(cmd + len, sizeof(cmd) - len, "'\\''");
+		else
+			cmd[len++] = *p;
+	}
+	snprintf(cmd + len, sizeof(cmd) - len, "?offset=%llu' 2>/dev/null",
+		 (unsigned long long)offset);
+
+	pipe = popen(cmd, "r");
+	if (!pipe) {
+		LOGE("Failed to run dumpe2fs: %s", strerror(errno));
+		return false;
+	}
+	while (fgets(line, sizeof(line), pipe)) {
+		if (!strncmp(line, "Block size:", 11)) {
+			block_size = strtoull(line + 11, NULL, 10);
+			continue;
+		}
+		/* per-group lines are indented, the summary count is not. */
+		p = strstr(line, "Free blocks: ");
+		if (!p || p == line || !block_size)
+			continue;
+		p += strlen("Free blocks: ");
+		while (*p >= '0' && *p <= '9') {
+			uint64_t first = strtoull(p, &p, 10), last = first;
+
+			if (*p == '-')
+				last = strtoull(p + 1, &p, 10);
+			if (!add_extent(unused, offset + first * block_size,
+					offset + (last + 1) * block_size))
+				goto end;
+			while (*p == ',' || *p == ' ')
+				p++;
+		}
+	}
+	ret = block_size != 0;
+end:
+	if (pclose(pipe) || !ret) {
+		LOGE("dumpe2fs failed on ext4 at offset %llu",
+		     (unsigned long long)offset);
+		ret = false;
+	}
+	return ret;
+}
+
+/*
+ * Collect the unused byte ranges of the image: free blocks of every ext4
+ * partition listed in the GPT. An image without a GPT gets no unused
+ * ranges, i.e. it is mapped completely.
+ */
+static bool scan_layout(int fd, const char *image_path, extent_list *unused)
+{
+	uint8_t hdr[SECTOR_SIZE], sb[SECTOR_SIZE];
+	uint8_t *entries = NULL;
+	uint64_t entries_lba;
+	uint32_t entry_num, entry_size, i;
+	bool ret = false;
+
+	if (pread(fd, hdr, sizeof(hdr), SECTOR_SIZE) != sizeof(hdr) ||
+	    memcmp(hdr, GPT_SIGNATURE, 8)) {
+		printf("%s: no GPT, mapping the whole image\n", image_path);
+		return true;
+	}
+	entries_lba = get_le(hdr + 0x48, 8);
+	entry_num = get_le(hdr + 0x50, 4);
+	entry_size = get_le(hdr + 0x54, 4);
+	if (entry_size < 128 || entry_num > 1024) {
+		LOGE("Malformed GPT in %s", image_path);
+		return false;
+	}
+
+	entries = malloc((size_t)entry_num * entry_size);
+	if (!entries ||
+	    pread(fd, entries, (size_t)entry_num * entry_size,
+		  entries_lba * SECTOR_SIZE) != (ssize_t)entry_num * entry_size) {
+		LOGE("Failed to read GPT entries of %s", image_path);
+		goto end;
+	}
+
+	for (i = 0; i < entry_num; i++) {
+		const uint8_t *entry = entries + (size_t)i * entry_size;
+		uint64_t first = get_le(entry + 0x20, 8);
+		uint64_t offset = first * SECTOR_SIZE;
+		static const uint8_t zero_guid[16];
+
+		if (!memcmp(entry, zero_guid, sizeof(zero_guid)))
+			continue;
+		if (pread(fd, sb, sizeof(sb), offset + EXT4_SB_OFFSET) != sizeof(sb) ||
+		    get_le(sb + EXT4_SB_MAGIC_OFFSET, 2) != EXT4_SB_MAGIC)
+			continue;
+		if (!ext4_free_blocks(image_path, offset, unused))
+			goto end;
+	}
+	ret = true;
+end:
+	free(entries);
+	return ret;
+}
+
+/*
+ * Map every block of the image except the ones lying completely inside an
+ * unused range.
+ */
+static bool build_map(bmap *map, extent_list *unused)
+{
+	uint64_t block = 0;
+	int i;
+
+	qsort(unused->list, unused->num, sizeof(*unused->list), cmp_extent);
+	for (i = 0; i < unused->num; i++) {
+		uint64_t first = (unused->list[i].start + map->block_size - 1) /
+				 map->block_size;
+		uint64_t end = unused->list[i].end / map->block_size;
+
+		if (end > map->blocks)
+			end = map->blocks;
+		if (first < block)
+			first = block;
+		if (first >= end)
+			continue;
+		if (first > block && !add_range(map, block, first - 1))
+			return false;
+		block = end;
+	}
+	if (block < map->blocks && !add_range(map, block, map->blocks - 1))
+		return false;
+	return true;
+}
+
+static int create_bmap(const char *image_path, const char *bmap_path)
+{
+	char path[4096];
+	struct stat st;
+	extent_list unused;
+	bmap map;
+	FILE *out = NULL;
+	int fd = -1;
+	int ret = -1;
+	int i;
+
+	memset(&map, 0, sizeof(map));
+	memset(&unused, 0, sizeof(unused));
+	if (!bmap_path) {
+		snprintf(path, sizeof(path), "%s.bmap", image_path);
+		bmap_path = path;
+	}
+
+	fd = open(image_path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		LOGE("Failed to open:%s", image_path);
+		goto end;
+	}
+	map.image_size = st.st_size;
+	map.block_size = BMAP_BLOCK_SIZE;
+	map.blocks = (map.image_size + map.block_size - 1) / map.block_size;
+
+	if (!scan_layout(fd, image_path, &unused) || !build_map(&map, &unused))
+		goto end;
+
+	out = fopen(bmap_path, "w");
+	if (!out) {
+		LOGE("Failed to create:%s", bmap_path);
+		goto end;
+	}
+	fprintf(out, "<?xml version=\"1.0\" ?>\n");
+	fprintf(out, "<bmap version=\"%s\">\n", BMAP_VERSION);
+	fprintf(out, "    <ImageSize> %llu </ImageSize>\n",
+		(unsigned long long)map.image_size);
+	fprintf(out, "    <BlockSize> %u </BlockSize>\n", map.block_size);
+	fprintf(out, "    <BlocksCount> %llu </BlocksCount>\n",
+		(unsigned long long)map.blocks);
+	fprintf(out, "    <MappedBlocksCount> %llu </MappedBlocksCount>\n",
+		(unsigned long long)map.mapped_blocks);
+	fprintf(out, "    <BlockMap>\n");
+	for (i = 0; i < map.range_num; i++) {
+		if (map.ranges[i].first == map.ranges[i].last)
+			fprintf(out, "        <Range> %llu </Range>\n",
+				(unsigned long long)map.ranges[i].first);
+		else
+			fprintf(out, "        <Range> %llu-%llu </Range>\n",
+				(unsigned long long)map.ranges[i].first,
+				(unsigned long long)map.ranges[i].last);
+	}
+	fprintf(out, "    </BlockMap>\n");
+	fprintf(out, "</bmap>\n");
+	if (fclose(out)) {
+		out = NULL;
+		LOGE("Failed to write:%s", bmap_path);
+		goto end;
+	}
+	out = NULL;
+
+	printf("%s: %llu of %llu blocks mapped (%llu MiB of %llu MiB), %d ranges\n",
+	       bmap_path, (unsigned long long)map.mapped_blocks,
+	       (unsigned long long)map.blocks,
+	       (unsigned long long)(map.mapped_blocks * map.block_size >> 20),
+	       (unsigned long long)(map.image_size >> 20), map.range_num);
+	ret = 0;
+end:
+	if (out)
+		fclose(out);
+	if (fd >= 0)
+		close(fd);
+	free(unused.list);
+	free(map.ranges);
+	return ret;
+}
+
+/* returns the trimmed text between <tag> and </tag>, or NULL. */
+static char *get_tag(char *xml, const char *tag, char **next)
+{
+	char open_tag[64], close_tag[64];
+	char *start, *end;
+
+	snprintf(open_tag, sizeof(open_tag), "<%s", tag);
+	snprintf(close_tag, sizeof(close_tag), "</%s>", tag);
+	start = strstr(xml, open_tag);
+	if (!start)
+		return NULL;
+	start = strchr(start, '>');
+	if (!start)
+		return NULL;
+	start++;
+	end = strstr(start, close_tag);
+	if (!end)
+		return NULL;
+	if (next)
+		*next = end + strlen(close_tag);
+	*end = '\0';
+	while (*start == ' ' || *start == '\t' || *start == '\n')
+		start++;
+	return start;
+}
+
+static bool parse_bmap(const char *bmap_path, bmap *map)
+{
+	char *xml = NULL, *pos, *val;
+	struct stat st;
+	FILE *file;
+	bool ret = false;
+
+	file = fopen(bmap_path, "r");
+	if (!file || fstat(fileno(file), &st) < 0) {
+		LOGE("Failed to open:%s", bmap_path);
+		goto end;
+	}
+	xml = calloc(1, st.st_size + 1);
+	if (!xml || fread(xml, 1, st.st_size, file) != (size_t)st.st_size) {
+		LOGE("Failed to read:%s", bmap_path);
+		goto end;
+	}
+
+	val = get_tag(xml, "ImageSize", &pos);
+	if (!val)
+		goto bad;
+	map->image_size = strtoull(val, NULL, 10);
+	val = get_tag(pos, "BlockSize", &pos);
+	if (!val)
+		goto bad;
+	map->block_size = strtoul(val, NULL, 10);
+	if (!map->block_size || map->block_size % 512)
+		goto bad;
+	map->blocks = (map->image_size + map->block_size - 1) / map->block_size;
+
+	pos = strstr(pos, "<BlockMap>");
+	if (!pos)
+		goto bad;
+	while ((val = get_tag(pos, "Range", &pos))) {
+		char *dash;
+		uint64_t first, last;
+
+		first = strtoull(val, &dash, 10);
+		last = *dash == '-' ? strtoull(dash + 1, NULL, 10) : first;
+		if (last < first || last >= map->blocks)
+			goto bad;
+		if (!add_range(map, first, last))
+			goto end;
+	}
+	ret = true;
+	goto end;
+bad:
+	LOGE("Malformed bmap:%s", bmap_path);
+end:
+	if (file)
+		fclose(file);
+	free(xml);
+	return ret;
+}
+
+static bool write_all(int fd, const char *buf, size_t len, off_t offset)
+{
+	while (len) {
+		ssize_t n = pwrite(fd, buf, len, offset);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			LOGE("Write failed at %lld: %s", (long long)offset,
+			     strerror(errno));
+			return false;
+		}
+		buf += n;
+		len -= n;
+		offset += n;
+	}
+	return true;
+}
+
+static int flash_image(const char *image_path, const char *bmap_path,
+		       const char *dev_path, bool direct)
+{
+	int in_fd = -1, out_fd = -1, tail_fd = -1;
+	uint64_t written = 0;
+	char *buf = NULL;
+	struct stat st;
+	double start;
+	bmap map;
+	int ret = -1;
+	int i;
+
+	memset(&map, 0, sizeof(map));
+	if (!parse_bmap(bmap_path, &map))
+		goto end;
+
+	in_fd = open(image_path, O_RDONLY);
+	if (in_fd < 0) {
+		LOGE("Failed to open:%s", image_path);
+		goto end;
+	}
+	posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	/* the unaligned image tail (if any) goes through the page cache. */
+	tail_fd = open(dev_path, O_WRONLY | O_CREAT, 0644);
+	if (tail_fd < 0 || fstat(tail_fd, &st) < 0) {
+		LOGE("Failed to open:%s", dev_path);
+		goto end;
+	}
+	if (S_ISBLK(st.st_mode)) {
+		uint64_t dev_size = 0;
+
+		if (!ioctl(tail_fd, BLKGETSIZE64, &dev_size) &&
+		    dev_size < map.image_size) {
+			LOGE("%s is too small (%llu < %llu bytes)", dev_path,
+			     (unsigned long long)dev_size,
+			     (unsigned long long)map.image_size);
+			goto end;
+		}
+	} else if (S_ISREG(st.st_mode)) {
+		/* unmapped ranges must read back as zeroes. */
+		if (ftruncate(tail_fd, 0) || ftruncate(tail_fd, map.image_size)) {
+			LOGE("Failed to resize:%s", dev_path);
+			goto end;
+		}
+	}
+
+	out_fd = direct ? open(dev_path, O_WRONLY | O_DIRECT) : -1;
+	if (out_fd < 0) {
+		/* tmpfs and friends do not support O_DIRECT. */
+		out_fd = tail_fd;
+		direct = false;
+	}
+
+	if (posix_memalign((void **)&buf, DIRECT_ALIGN, CHUNK_SIZE)) {
+		LOGE("Out of memory");
+		goto end;
+	}
+
+	start = now();
+	for (i = 0; i < map.range_num; i++) {
+		off_t offset = map.ranges[i].first * map.block_size;
+		off_t end = (map.ranges[i].last + 1) * map.block_size;
+
+		if (end > (off_t)map.image_size)
+			end = map.image_size;
+		while (offset < end) {
+			size_t len = end - offset > CHUNK_SIZE ? CHUNK_SIZE : end - offset;
+			size_t aligned = len & ~((size_t)DIRECT_ALIGN - 1);
+			ssize_t n;
+
+			if (!direct) {
+				aligned = len;
+			} else if (offset % DIRECT_ALIGN) {
+				/*
+				 * bmaps with blocks smaller than DIRECT_ALIGN: go
+				 * through the page cache up to the next aligned offset.
+				 */
+				if (len > DIRECT_ALIGN - offset % DIRECT_ALIGN)
+					len = DIRECT_ALIGN - offset % DIRECT_ALIGN;
+				aligned = 0;
+			}
+			n = pread(in_fd, buf, len, offset);
+			if (n != (ssize_t)len) {
+				LOGE("Failed to read image at %lld", (long long)offset);
+				goto end;
+			}
+			if (aligned && !write_all(out_fd, buf, aligned, offset))
+				goto end;
+			if (len > aligned &&
+			    !write_all(tail_fd, buf + aligned, len - aligned,
+				       offset + aligned))
+				goto end;
+			offset += len;
+			written += len;
+		}
+	}
+	if (fsync(out_fd) || (out_fd != tail_fd && fsync(tail_fd))) {
+		LOGE("Failed to sync:%s", dev_path);
+		goto end;
+	}
+
+	printf("Wrote %llu MiB of %llu MiB to %s in %.1fs\n",
+	       (unsigned long long)(written >> 20),
+	       (unsigned long long)(map.image_size >> 20), dev_path, now() - start);
+	ret = 0;
+end:
+	if (out_fd >= 0 && out_fd != tail_fd)
+		close(out_fd);
+	if (tail_fd >= 0)
+		close(tail_fd);
+	if (in_fd >= 0)
+		close(in_fd);
+	free(buf);
+	free(map.ranges);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	bool direct = true;
+
+	argc--, argv++;
+	if (argc > 0 && !strcmp(argv[0], "--create")) {
+		if (argc < 2 || argc > 3) {
+			usage();
+			return -1;
+		}
+		return create_bmap(argv[1], argc > 2 ? argv[2] : NULL);
+	}
+	if (argc > 0 && !strcmp(argv[0], "--no-direct")) {
+		direct = false;
+		argc--, argv++;
+	}
+	if (argc != 3) {
+		usage();
+		return -1;
+	}
+	return flash_image(argv[0], argv[1], argv[2], direct);
+}
@@ -13,6 +13,9 @@ SCRIPTS="${ROOT}/scripts"       # 构建脚本目录
 DEST="${BUILD}/rootfs"          # rootfs 目标目录
 UBOOT_BIN="$BUILD/uboot"        # U-Boot 编译输出目录
 PACK_OUT="${BUILD}/pack/"       # 固件打包输出目录
+CACHE="${BUILD}/cache"          # 构建缓存目录 (按内容哈希索引)
+APT_CACHE=""                    # 共享 apt 软件包缓存目录 (选择发行版后确定)
+ROOTFS_BASE_KEY=""              # rootfs base 层缓存 key (确定软件源后计算)
 
 # ========== 配置变量初始化 ==========
 OS=""                           # 操作系统类型
@@ -29,10 +32,12 @@ BUILD_MODULE=""                 # 是否构建内核模块标志
 
 # ========== 全局设置 ==========
 SOURCES="CN"                    # 软件源地区 (CN=中国)
+ROOTFS_SNAPSHOT=""               # 软件源快照标识 (变化时 rootfs 缓存失效)
 METHOD="download"               # 下载方式
 KERNEL_NAME="linux"             # 内核名称
 UNTAR="bsdtar -xpf"            # 解压工具命令
 CORES=$(nproc --ignore=1)      # 编译使用的 CPU 核心数 (总数-1)
+RELEASE_COMPRESS="zstd"        # 发布镜像压缩方式 (zstd/xz/gzip)
 PLATFORM="$(basename `pwd`)"   # 平台名称 (从当前目录名提取)
 
 # ========== 权限检查 ==========
@@ -50,6 +55,8 @@ fi
 
 # ========== 导入功能库 ==========
 source "${SCRIPTS}"/lib/general.sh        # 通用功能库 (系统准备、依赖检查)
+source "${SCRIPTS}"/lib/cache.sh          # 构建缓存库 (按内容哈希缓存产物)
+source "${SCRIPTS}"/lib/schedule.sh       # 阶段调度库 (按依赖并行执行构建阶段)
 source "${SCRIPTS}"/lib/pack.sh           # 打包工具库 (H3/H6 固件打包)
 source "${SCRIPTS}"/lib/compilation.sh    # 编译功能库 (内核、U-Boot 编译)
 source "${SCRIPTS}"/lib/distributions.sh  # 发行版构建库 (rootfs 构建)
@@ -191,6 +198,7 @@ case "${PLATFORM}" in
 		# RK3399 使用 Linaro GCC 6.3.1 工具链
 		TOOLS=$ROOT/toolchain/gcc-linaro-6.3.1-2017.05-x86_64_aarch64-linux-gnu/bin/aarch64-linux-gnu-
 		KERNEL_NAME="linux4.4.179" # Linux 4.4.179 长期支持版本
+		BOARDS="4 rk3399"         # 全部开发板 (矩阵编译使用)
 		;;
 	# ===== 未识别的平台 =====
 	*)
@@ -211,6 +219,7 @@ OPTION=$(whiptail --title "OrangePi Build System" \
 	"5"   "Update Kernel Image" \     # 更新已有镜像中的内核
 	"6"   "Update Module" \           # 更新已有 rootfs 中的内核模块
 	"7"   "Update Uboot" \            # 更新已有镜像中的 U-Boot
+	"8"   "Build Linux (all boards)" \ # 一次编译内核，生成所有开发板的 boot.img
 	3>&1 1>&2 2>&3)
 
 # ========== 构建选项执行 ==========
@@ -218,10 +227,9 @@ case "${OPTION}" in
 	# ===== 选项 0: 完整构建发布镜像 =====
 	"0")
 		select_distro     # 选择 Linux 发行版 (Ubuntu/Debian 等)
-		compile_uboot     # 编译 U-Boot 引导加载器
-		compile_kernel    # 编译 Linux 内核
-		build_rootfs      # 构建根文件系统
-		build_image       # 打包最终可烧录镜像
+		# U-Boot、内核、rootfs 并行构建，全部完成后配置 rootfs 并打包最终可烧录镜像
+		add_build_stages image
+		run_stages
 
 		# 显示构建成功提示
 		whiptail --title "OrangePi Build System" --msgbox "Succeed to build Image" \
@@ -230,9 +238,9 @@ case "${OPTION}" in
 	# ===== 选项 1: 仅构建根文件系统 =====
 	"1")
 		select_distro     # 选择 Linux 发行版
-		compile_uboot     # 编译 U-Boot (生成引导文件)
-		compile_kernel    # 编译内核 (生成 zImage/boot.img)
-		build_rootfs      # 构建 rootfs (debootstrap + 配置)
+		# 并行编译 U-Boot、内核 (生成引导文件和 boot.img) 和构建 rootfs (debootstrap + 配置)
+		add_build_stages
+		run_stages
 		whiptail --title "OrangePi Build System" --msgbox "Succeed to build rootfs" \
 			10 40 0 --ok-button Continue
 		;;
@@ -265,6 +273,10 @@ case "${OPTION}" in
 		uboot_check       # 检查 uboot 分区是否存在
 		uboot_update      # 将新编译的 U-Boot 写入镜像
 		;;
+	# ===== 选项 8: 为所有开发板编译内核 =====
+	"8")
+		compile_kernel_matrix   # 按 defconfig 分组编译，各开发板并行打包 boot.img
+		;;
 	# ===== 无效选项 =====
 	*)
 		whiptail --title "OrangePi Build System" \
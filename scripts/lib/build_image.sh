@@ -1,5 +1,83 @@
 #!/bin/bash
 
+# 编译主机端块映射/烧录工具（external/bmap_flash）
+build_bmap_tool()
+{
+	BMAP_FLASH="${EXTER}/bmap_flash/bmap_flash"
+
+	if [ ! -x $BMAP_FLASH -o ${EXTER}/bmap_flash/bmap_flash.c -nt $BMAP_FLASH ]; then
+		make -C ${EXTER}/bmap_flash
+	fi
+}
+
+# 为镜像生成 bmap 块映射文件（<镜像>.bmap），需要 e2fsprogs 中的 dumpe2fs
+make_bmap()
+{
+	build_bmap_tool
+	$BMAP_FLASH --create $1
+}
+
+# 打包发布镜像（在 $BUILD/images 下生成压缩包和 MD5 校验和）
+# RELEASE_COMPRESS 选择压缩方式:
+#   zstd - 多线程 zstd，生成 <镜像>.img.zst（默认，最快）
+#   xz   - 多线程 xz，按 16MiB 独立分块，生成可随机访问的 <镜像>.img.xz
+#   gzip - 旧格式，单线程 tar.gz（镜像与校验和打包在一起）
+# zstd/xz 只读取一次镜像：tee 将数据流同时送给压缩器和 md5sum
+pack_release_image()
+{
+	local name=$1
+	local compress=""
+	local ext=""
+
+	cd ${BUILD}/images/
+
+	case "${RELEASE_COMPRESS}" in
+		"zstd")
+			compress="zstd -T${CORES} -10 -q -c"
+			ext="zst"
+			;;
+		"xz")
+			compress="xz -T${CORES} -6 --block-size=16MiB -c"
+			ext="xz"
+			;;
+		*)
+			rm -f ${name}.tar.gz
+			md5sum ${name}.img > ${name}.img.md5sum
+			tar czvSf ${name}.tar.gz ${name}.img*
+			rm -f ${name}.img.md5sum
+			cd -
+			return
+			;;
+	esac
+
+	rm -f ${name}.img.${ext} ${name}.img.md5sum
+	local tmp=$(mktemp -d)
+	local fifo=$tmp/md5
+	local rc=0
+	mkfifo $fifo
+	# md5sum 从 FIFO 读取，输出中的 "-" 替换为镜像文件名，便于 md5sum -c 校验
+	md5sum < $fifo | sed "s|-\$|${name}.img|" > ${name}.img.md5sum &
+	local md5_pid=$!
+	# tee 或压缩器任一失败都视为打包失败
+	(set -o pipefail; tee $fifo < ${name}.img | $compress > ${name}.img.${ext}) || rc=$?
+	wait $md5_pid || rc=1
+	rm -rf $tmp
+	if [ $rc != 0 ]; then
+		rm -f ${name}.img.${ext} ${name}.img.md5sum
+		echo -e "\e[1;31m Compress ${name}.img failed \e[0m"
+		exit 1
+	fi
+
+	# 块映射文件与压缩镜像一起发布（bmaptool/bmap_flash 烧录时使用）
+	if [ -f ${name}.img.bmap ]; then
+		md5sum ${name}.img.bmap >> ${name}.img.md5sum
+		echo "Block map: ${BUILD}/images/${name}.img.bmap"
+	fi
+
+	echo "Release image: ${BUILD}/images/${name}.img.${ext}"
+	cd -
+}
+
 # RK3399 平台镜像构建函数（使用 GPT 分区表）
 build_rk_image()
 {
@@ -30,8 +108,8 @@ build_rk_image()
 	# 转换为 MB 并向上取整 + 2MB 对齐
 	local GPT_IMAGE_SIZE=$(expr $GPTIMG_MIN_SIZE \/ 1024 \/ 1024 + 2)
 
-	# 创建临时 rootfs 镜像文件（用零填充）
-	dd if=/dev/zero of=${IMAGE}2 bs=1M count=$(expr $IMG_ROOTFS_SIZE  \/ 1024 )
+	# 创建临时 rootfs 镜像文件（稀疏文件，只有 mkfs 和复制的数据占用实际空间）
+	dd if=/dev/zero of=${IMAGE}2 bs=1M count=0 seek=$(expr $IMG_ROOTFS_SIZE  \/ 1024 )
 	# 格式化为 ext4 文件系统
 	# -O ^metadata_csum: 禁用元数据校验和（兼容性考虑）
 	# -b 4096: 块大小 4KB
@@ -98,19 +176,15 @@ EOF
 	# 写入 boot.img（内核 + dtb + initrd）到 boot 分区
 	dd if=$BUILD/kernel/boot.img of=$IMAGE seek=$BOOT_START conv=notrunc,fsync
 	# 写入 rootfs.img（根文件系统）到 rootfs 分区
-	dd if=${IMAGE}2 of=$IMAGE seek=$ROOTFS_START conv=notrunc,fsync
+	# sparse: 全零块在镜像文件中保持为空洞（只节省主机磁盘空间，块映射不依赖空洞）
+	dd if=${IMAGE}2 of=$IMAGE bs=1M seek=$((ROOTFS_START * 512)) oflag=seek_bytes conv=notrunc,sparse,fsync
 	# 删除临时 rootfs 镜像文件
 	rm -f ${IMAGE}2
-	# 切换到镜像输出目录
-	cd ${BUILD}/images/
-	# 删除旧的压缩包
-	rm -f ${IMAGENAME}.tar.gz
-	# 生成镜像 MD5 校验和文件（用于验证下载完整性）
-	md5sum ${IMAGENAME}.img > ${IMAGENAME}.img.md5sum
-	# 打包镜像和校验和文件为 tar.gz 压缩包
-	tar czvf  ${IMAGENAME}.tar.gz $IMAGENAME.img*
-	# 删除临时校验和文件（已打包进 tar.gz）
-	rm -f *.md5sum
+	# 生成块映射文件：按 GPT 分区表和 ext4 块位图生成，只跳过 ext4 中未分配的块
+	# 烧录时使用: bmap_flash ${IMAGENAME}.img ${IMAGENAME}.img.bmap /dev/sdX
+	make_bmap $IMAGE
+	# 压缩发布镜像并生成 MD5 校验和
+	pack_release_image ${IMAGENAME}
 
 	# 同步磁盘缓存到存储设备
 	sync
@@ -297,16 +371,8 @@ t                                                        # 修改分区类型
 w                                                        # 写入分区表并退出
 EOF
 
-	# 切换到镜像输出目录
-	cd ${BUILD}/images/
-	# 删除旧的压缩包
-	rm -f ${IMAGENAME}.tar.gz
-	# 生成 MD5 校验和
-	md5sum ${IMAGE} > ${IMAGE}.md5sum
-	# 打包镜像和校验和文件
-	tar czvf  ${IMAGENAME}.tar.gz $IMAGENAME.img*
-	# 删除临时校验和文件
-	rm -f *.md5sum
+	# 压缩发布镜像并生成 MD5 校验和
+	pack_release_image ${IMAGENAME}
 
 	# 同步磁盘缓存
 	sync
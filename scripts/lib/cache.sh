@@ -0,0 +1,91 @@
+#!/bin/bash
+
+###############################################################################
+# cache.sh - 构建缓存库
+# 功能：按内容哈希（而不是文件名）索引构建产物，输入变化时缓存自动失效
+#
+# 缓存目录布局：$CACHE/<类别>/<名称>-<key>.tar.zst（归档）
+#               $CACHE/<类别>/<名称>-<key>/        （未压缩目录树）
+###############################################################################
+
+# 计算缓存 key：对所有参数（字符串）求 sha256，取前 16 位
+# 用法: cache_key <字段1> [字段2 ...]
+cache_key()
+{
+	printf '%s\n' "$@" | sha256sum | cut -c1-16
+}
+
+# 计算文件内容的缓存 key（文件名不参与计算，不存在的文件记为 missing）
+# 用法: cache_file_key <文件1> [文件2 ...]
+cache_file_key()
+{
+	local f
+
+	for f in "$@"; do
+		if [ -f "$f" ]; then
+			sha256sum < "$f"
+		else
+			echo "missing $(basename $f)"
+		fi
+	done | sha256sum | cut -c1-16
+}
+
+# 缓存归档路径
+# 用法: cache_path <类别> <名称> <key>
+cache_path()
+{
+	echo "${CACHE}/$1/$2-$3.tar.zst"
+}
+
+# 将目录打包保存到缓存（先写临时文件再改名，中断不会留下损坏的缓存）
+# 用法: cache_save <归档路径> <源目录>
+cache_save()
+{
+	local archive="$1"
+	local dir="$2"
+
+	mkdir -p $(dirname $archive)
+	tar -C "$dir" --numeric-owner --xattrs -I "zstd -T${CORES} -q" \
+		-cpf "${archive}.tmp" .
+	mv -f "${archive}.tmp" "$archive"
+	echo "Cache saved: $(basename $archive)"
+}
+
+# 从缓存恢复目录，缓存不存在时返回 1
+# 用法: cache_restore <归档路径> <目标目录>
+cache_restore()
+{
+	local archive="$1"
+	local dir="$2"
+
+	[ -f "$archive" ] || return 1
+
+	echo "Cache hit: $(basename $archive)"
+	mkdir -p "$dir"
+	tar -C "$dir" --numeric-owner --xattrs -I "zstd -T${CORES} -q" -xpf "$archive"
+}
+
+# 将目录树移入缓存（同一文件系统内 mv 只是改名，不复制数据）
+# 用法: cache_tree_save <源目录> <缓存目录>
+cache_tree_save()
+{
+	local src="$1"
+	local tree="$2"
+
+	mkdir -p $(dirname $tree)
+	rm -rf "${tree}.tmp"
+	mv "$src" "${tree}.tmp"
+	rm -rf "$tree"
+	mv "${tree}.tmp" "$tree"
+	echo "Cache saved: $(basename $tree)"
+}
+
+# 将缓存的目录树叠加到目标目录
+# 支持 reflink 的文件系统（btrfs/xfs）上只复制元数据；否则退化为普通复制。
+# 不使用硬链接：目标目录中的文件之后还可能被修改，硬链接会把修改写回缓存
+# 用法: cache_tree_apply <缓存目录> <目标目录>
+cache_tree_apply()
+{
+	echo "Cache hit: $(basename $1)"
+	cp -a --reflink=auto "$1"/. "$2"/
+}
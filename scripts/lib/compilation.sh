@@ -4,6 +4,12 @@
 # compile_uboot   - 编译 U-Boot 引导加载器
 # compile_kernel  - 编译 Linux 内核
 # compile_module  - 编译并安装内核模块
+# kernel_ccache_setup - 内核编译使用 ccache (主机已安装时)
+# kernel_defconfig - 配置变化时才重新生成内核 .config
+# kernel_stamp_key - 开发板内核完整编译标记的内容
+# kernel_dtb_only - 判断是否只有设备树发生变化
+# compile_kernel_matrix - 一次编译内核，为同平台所有开发板生成 boot.img
+# add_build_stages - 将 U-Boot、内核和 rootfs 构建添加到阶段调度器
 
 # ============================================================================
 # 函数: compile_uboot
@@ -24,7 +30,7 @@ compile_uboot()
 		whiptail --title "OrangePi Build System" \
 			--msgbox "u-boot doesn't exist, pls perpare u-boot source code." \
 			10 50 0
-		exit 0  # 退出脚本
+		exit 1  # 退出脚本 (作为构建阶段时使其失败)
 	fi
 
 	# 切换到 U-Boot 源码目录
@@ -79,7 +85,7 @@ compile_uboot()
 		*)
 			# 如果平台不匹配，打印错误信息并退出
 	        	echo -e "\e[1;31m Pls select correct platform \e[0m"
-	        	exit 0
+	        	exit 1
 			;;
 	esac
 
@@ -91,6 +97,79 @@ compile_uboot()
 	#	--msgbox "Build uboot finish. The output path: $BUILD" 10 60 0
 }
 
+# ============================================================================
+# 函数: kernel_ccache_setup
+# 功能: 主机安装了 ccache 时，用它包装内核交叉编译器
+#       缓存目录为 $CACHE/ccache，所有开发板共用；CCACHE_BASEDIR 使缓存 key
+#       只包含相对路径，源码目录移动后仍能命中
+# 输出: KMAKE_ARGS - 追加到内核 make 命令行的参数
+#       (每次 make 必须一致，否则 Kbuild 检测到 CC 变化会重新编译所有文件)
+# ============================================================================
+kernel_ccache_setup()
+{
+	KMAKE_ARGS=()
+	command -v ccache > /dev/null || return 0
+
+	export CCACHE_DIR=${CACHE}/ccache
+	export CCACHE_BASEDIR=${LINUX}
+	export CCACHE_COMPILERCHECK=content
+	mkdir -p $CCACHE_DIR
+	KMAKE_ARGS=("CC=ccache ${TOOLS}gcc")
+}
+
+# ============================================================================
+# 函数: kernel_defconfig
+# 功能: 加载内核 defconfig，defconfig 内容和当前 .config 都没有变化时跳过
+#       (make xxx_defconfig 会重写 .config 和 include/config，使大量目标
+#        被判定为过期，增量编译退化为几乎完整的编译)
+# 输入: $1 - defconfig 名称
+# ============================================================================
+kernel_defconfig()
+{
+	local stamp=$BUILD/kernel/.defconfig
+	local key=$(cache_file_key $LINUX/arch/${ARCH}/configs/$1)
+
+	if [ -f $LINUX/.config -a -f $stamp ] &&
+	   [ "$(cat $stamp)" = "$1 $key $(cache_file_key $LINUX/.config)" ]; then
+		echo -e "\e[1;32m $1 unchanged, keeping .config \e[0m"
+		return 0
+	fi
+
+	make -C $LINUX ARCH=${ARCH} CROSS_COMPILE=$TOOLS "${KMAKE_ARGS[@]}" $1 || return 1
+	echo "$1 $key $(cache_file_key $LINUX/.config)" > $stamp
+}
+
+# ============================================================================
+# 函数: kernel_stamp_key
+# 功能: 输出开发板内核完整编译标记 ($BUILD/kernel/.kernel-<board>) 的内容：
+#       make 参数 (CC 等) 和开发板 defconfig 的内容 key
+# ============================================================================
+kernel_stamp_key()
+{
+	echo "${KMAKE_ARGS[*]} $(cache_file_key $LINUX/arch/${ARCH}/configs/${BOARD}_linux_defconfig)"
+}
+
+# ============================================================================
+# 函数: kernel_dtb_only
+# 功能: 判断当前开发板上次完整编译之后，是否只有设备树源文件发生了变化
+#       检查范围：内核源码、Kconfig/Makefile、链接脚本、defconfig 和 .config
+#       (.config 被其他开发板的 defconfig 改写时同样视为变化)
+# 返回: 0 - 内核 Image 和模块无需重新编译，只需重新生成 resource.img/boot.img
+# ============================================================================
+kernel_dtb_only()
+{
+	local stamp=$BUILD/kernel/.kernel-${BOARD}
+
+	[ -f $stamp -a -f $LINUX/arch/${ARCH}/boot/Image -a -f $LINUX/boot.img ] || return 1
+	[ "$(cat $stamp)" = "$(kernel_stamp_key)" ] || return 1
+
+	[ -z "$(find $LINUX -path $LINUX/arch/${ARCH}/boot/dts -prune -o \
+		-path $LINUX/.git -prune -o -type f \
+		\( -name '*.[chS]' -o -name 'Kconfig*' -o -name 'Makefile*' \
+		-o -name 'Kbuild' -o -name '*.lds*' -o -name '.config' \) \
+		-newer $stamp -print -quit)" ]
+}
+
 # ============================================================================
 # 函数: compile_kernel
 # 功能: 根据不同平台编译 Linux 内核
@@ -180,14 +259,31 @@ compile_kernel()
 
 		# ===== Rockchip RK3399 平台 =====
 		"OrangePiRK3399")
-			# 加载开发板特定的内核配置文件 (如 orangepi_linux_defconfig)
-			make -C $LINUX ARCH=${ARCH} CROSS_COMPILE=$TOOLS ${BOARD}_linux_defconfig
-			echo -e "\e[1;31m Using ${BOARD}_linux_defconfig\e[0m"
-			# 编译 Rockchip 特定的 .img 格式 (包含内核+设备树+资源)
-			# 目标格式: rk3399-orangepi-<board>.img
-			make -C $LINUX ARCH=${ARCH} CROSS_COMPILE=$TOOLS -j${CORES} rk3399-orangepi-${BOARD}.img
-			# 编译内核模块
-			make -C $LINUX ARCH=${ARCH} CROSS_COMPILE=$TOOLS -j${CORES} modules
+			kernel_ccache_setup
+
+			if kernel_dtb_only; then
+				# 只有设备树变化：单独编译 dtb，再用 mkimg 重新打包
+				# resource.img 和 boot.img，不重新链接内核
+				echo -e "\e[1;31m Only device tree changed, repacking boot.img\e[0m"
+				make -C $LINUX ARCH=${ARCH} CROSS_COMPILE=$TOOLS "${KMAKE_ARGS[@]}" \
+					rockchip/rk3399-orangepi-${BOARD}.dtb || exit 1
+				(cd $LINUX && ARCH=${ARCH} ./scripts/mkimg --dtb rk3399-orangepi-${BOARD}.dtb) || exit 1
+			else
+				# 编译前删除完整编译标记，编译失败时下次不会误判为只有设备树变化
+				rm -f $BUILD/kernel/.kernel-${BOARD}
+				# 加载开发板特定的内核配置文件 (如 orangepi_linux_defconfig)
+				kernel_defconfig ${BOARD}_linux_defconfig || exit 1
+				echo -e "\e[1;31m Using ${BOARD}_linux_defconfig\e[0m"
+				# 编译 Rockchip 特定的 .img 格式 (包含内核+设备树+资源)
+				# 目标格式: rk3399-orangepi-<board>.img
+				make -C $LINUX ARCH=${ARCH} CROSS_COMPILE=$TOOLS "${KMAKE_ARGS[@]}" \
+					-j${CORES} rk3399-orangepi-${BOARD}.img || exit 1
+				# 编译内核模块
+				make -C $LINUX ARCH=${ARCH} CROSS_COMPILE=$TOOLS "${KMAKE_ARGS[@]}" \
+					-j${CORES} modules || exit 1
+				# 全部编译成功后才写入标记
+				kernel_stamp_key > $BUILD/kernel/.kernel-${BOARD}
+			fi
 			# 拷贝生成的 boot.img 到输出目录
 			# boot.img 是 Rockchip 格式的启动镜像，包含内核和设备树
 			cp $LINUX/boot.img $BUILD/kernel
@@ -197,13 +293,127 @@ compile_kernel()
 		*)
 			# 平台不匹配时报错并退出
 	        	echo -e "\e[1;31m Pls select correct platform \e[0m"
-			exit 0
+			exit 1
 	esac
 
 	# 打印编译完成提示
 	echo -e "\e[1;31m Complete kernel compilation ...\e[0m"
 }
 
+# ============================================================================
+# 函数: build_resource_tool
+# 功能: 用主机 gcc 编译 U-Boot 源码中的 resource_tool，源码更新时重新编译；
+#       主机有 libzstd 时支持 --compress=zstd
+# 输出: RESOURCE_TOOL - resource_tool 路径
+# ============================================================================
+build_resource_tool()
+{
+	local src=$UBOOT/tools/rockchip
+	local zstd=""
+
+	RESOURCE_TOOL=$BUILD/kernel/resource_tool
+
+	if [ ! -x $RESOURCE_TOOL -o $src/resource_tool.c -nt $RESOURCE_TOOL ]; then
+		pkg-config --exists libzstd 2>/dev/null && \
+			zstd="-DHAVE_ZSTD $(pkg-config --cflags --libs libzstd)"
+		gcc -O2 -DUSE_HOSTCC -o $RESOURCE_TOOL $src/resource_tool.c $zstd
+	fi
+}
+
+# ============================================================================
+# 函数: kernel_pack_board
+# 功能: 用开发板自己的 dtb 和共用的内核 Image 生成 resource.img 和 boot.img，
+#       布局与内核 rk3399-orangepi-<board>.img 目标 (scripts/mkimg) 相同
+# 输入: $1 - 开发板名称，$BUILD/kernel/<board>/ 中已有 Image 和 dtb
+# 输出: $BUILD/kernel/<board>/resource.img, boot.img
+# ============================================================================
+kernel_pack_board()
+{
+	local out=$BUILD/kernel/$1
+
+	# dtb 固定以 rk-kernel.dtb 打包；logo 以相对 $LINUX 的名称打包 (与 mkimg 相同)，
+	# U-Boot 按 logo.bmp/logo_kernel.bmp 查找
+	$RESOURCE_TOOL --pack --root=$LINUX --image=$out/resource.img \
+		$out/rk3399-orangepi-$1.dtb $LINUX/logo.bmp $LINUX/logo_kernel.bmp
+	$LINUX/scripts/mkbootimg --kernel $out/Image --second $out/resource.img \
+		-o $out/boot.img
+}
+
+# ============================================================================
+# 函数: compile_kernel_matrix
+# 功能: 为当前平台的所有开发板 ($BOARDS) 编译内核
+#       defconfig 内容相同的开发板为一组，每组只编译一次内核 Image 和模块，
+#       再编译组内各开发板的 dtb；各开发板的 resource.img/boot.img 在后台
+#       并行打包，同时开始下一组的编译
+# 输出: $BUILD/kernel/<board>/boot.img - 各开发板的启动镜像
+#       $BUILD/kernel/modules-<key>/lib/modules - 每组的内核模块
+#       $BUILD/kernel/boot.img, $BUILD/lib/modules - 当前开发板 ($BOARD) 的产物
+# ============================================================================
+compile_kernel_matrix()
+{
+	local -A family
+	local key b dtbs pids
+	local failed=0
+
+	if [ "${PLATFORM}" != "OrangePiRK3399" ]; then
+		echo -e "\e[1;31m Matrix build is only supported on OrangePiRK3399 \e[0m"
+		exit 1
+	fi
+
+	mkdir -p $BUILD/kernel
+	kernel_ccache_setup
+	build_resource_tool
+
+	# 按 defconfig 内容分组
+	for b in ${BOARDS}; do
+		key=$(cache_file_key $LINUX/arch/${ARCH}/configs/${b}_linux_defconfig)
+		family[$key]="${family[$key]} $b"
+	done
+
+	for key in "${!family[@]}"; do
+		set -- ${family[$key]}
+		echo -e "\e[1;31m Building kernel for boards:${family[$key]} \e[0m"
+
+		dtbs=""
+		for b in "$@"; do
+			dtbs="$dtbs rockchip/rk3399-orangepi-${b}.dtb"
+		done
+
+		kernel_defconfig ${1}_linux_defconfig || exit 1
+		make -C $LINUX ARCH=${ARCH} CROSS_COMPILE=$TOOLS "${KMAKE_ARGS[@]}" \
+			-j${CORES} Image modules $dtbs || exit 1
+		rm -rf $BUILD/kernel/modules-$key
+		make -C $LINUX ARCH=${ARCH} CROSS_COMPILE=$TOOLS "${KMAKE_ARGS[@]}" \
+			modules_install INSTALL_MOD_PATH=$BUILD/kernel/modules-$key || exit 1
+
+		# 先复制本组的产物，下一组编译时会覆盖源码目录中的 Image
+		for b in "$@"; do
+			mkdir -p $BUILD/kernel/$b
+			cp $LINUX/arch/${ARCH}/boot/Image $BUILD/kernel/$b/ || exit 1
+			cp $LINUX/arch/${ARCH}/boot/dts/rockchip/rk3399-orangepi-${b}.dtb $BUILD/kernel/$b/ || exit 1
+			ln -sfn ../modules-$key $BUILD/kernel/$b/modules
+			kernel_pack_board $b &
+			pids="$pids $!"
+		done
+	done
+
+	for b in $pids; do
+		wait $b || failed=1
+	done
+	if [ $failed = 1 ]; then
+		echo -e "\e[1;31m Failed to pack boot.img \e[0m"
+		exit 1
+	fi
+
+	# 当前开发板的产物放到单板编译的位置，后续 rootfs 和镜像打包直接使用
+	if [ -d $BUILD/kernel/${BOARD} ]; then
+		cp $BUILD/kernel/${BOARD}/boot.img $BUILD/kernel/boot.img
+		sync_modules $BUILD/kernel/${BOARD}/modules $BUILD
+	fi
+
+	echo -e "\e[1;31m Complete kernel compilation for:${BOARDS} \e[0m"
+}
+
 # ============================================================================
 # 函数: compile_module
 # 功能: 编译并安装内核模块 (驱动程序)
@@ -212,23 +422,30 @@ compile_kernel()
 # ============================================================================
 compile_module(){
 
-	# 准备模块输出目录
-	if [ ! -d $BUILD/lib ]; then
-	        mkdir -p $BUILD/lib  # 不存在则创建
-	else
-	        rm -rf $BUILD/lib/*  # 存在则清空旧模块文件
-	fi
+	# 准备模块临时安装目录 (modules_install 每次都会重写全部文件)
+	rm -rf $BUILD/.modules
+	mkdir -p $BUILD/.modules
 
 	# 开始编译和安装内核模块
 	echo -e "\e[1;31m Start installing kernel modules ... \e[0m"
 
+	# RK3399 的内核由 compile_kernel 通过 ccache 编译，这里必须使用相同的 CC，
+	# 否则 Kbuild 会因编译命令变化而重新编译所有模块
+	KMAKE_ARGS=()
+	[ "${PLATFORM}" = "OrangePiRK3399" ] && kernel_ccache_setup
+
 	# 编译所有内核模块 (.ko 文件)
 	# 模块包括：设备驱动、文件系统、网络协议等可动态加载的内核组件
-	make -C $LINUX ARCH="${ARCH}" CROSS_COMPILE=$TOOLS -j${CORES} modules
+	make -C $LINUX ARCH="${ARCH}" CROSS_COMPILE=$TOOLS "${KMAKE_ARGS[@]}" -j${CORES} modules
 
-	# 安装编译好的模块到指定目录
-	# INSTALL_MOD_PATH: 指定安装根路径，模块将安装到 $BUILD/lib/modules/<kernel-version>/
-	make -C $LINUX ARCH="${ARCH}" CROSS_COMPILE=$TOOLS -j${CORES} modules_install INSTALL_MOD_PATH=$BUILD
+	# 安装编译好的模块到临时目录
+	# INSTALL_MOD_PATH: 指定安装根路径，模块将安装到 $BUILD/.modules/lib/modules/<kernel-version>/
+	make -C $LINUX ARCH="${ARCH}" CROSS_COMPILE=$TOOLS "${KMAKE_ARGS[@]}" -j${CORES} modules_install INSTALL_MOD_PATH=$BUILD/.modules
+
+	# 增量同步到 $BUILD/lib/modules，内容未变化的模块保留原修改时间，
+	# 之后 modules_update 同步到 SD 卡时可以直接跳过
+	sync_modules $BUILD/.modules $BUILD
+	rm -rf $BUILD/.modules
 
 	# 打印安装完成提示
 	echo -e "\e[1;31m Complete kernel module installation ... \e[0m"
@@ -237,3 +454,35 @@ compile_module(){
 	#whiptail --title "OrangePi Build System" --msgbox \
 	#	"Build Kernel OK. The path of output file: ${BUILD}" 10 80 0
 }
+
+# ============================================================================
+# 函数: add_build_stages
+# 功能: 将完整构建拆分为调度阶段 (见 schedule.sh)，互不依赖的阶段并行执行
+#       uboot / kernel / rootfs 三者之间没有共享输入，只有 rootfs 配置阶段
+#       (安装内核模块、拷贝 boot.img 和 U-Boot 镜像) 需要等待它们全部完成
+# 输入: $1 - 非空时追加 image 阶段 (打包最终镜像)
+# 核数: rootfs 主要耗时在 QEMU 模拟和下载，只占 1 核；U-Boot 较小，
+#       占 1/4；其余留给内核 (先添加的阶段先分配)
+# 注意: 阶段在子 shell 中执行，阶段内设置的变量不会传给后续阶段，
+#       rootfs 两个阶段共用的软件源和缓存 key 在这里预先确定
+#       rootfs 阶段没有输入，每次都执行 (rootfs_setup 会修改 $DEST，不能跳过)，
+#       重复构建由各层 rootfs 缓存保证速度
+# ============================================================================
+add_build_stages()
+{
+	local uboot_cores=$((CORES / 4))
+
+	rootfs_select_sources
+
+	stage_add rootfs build_rootfs_layers 1 "" "" ""
+	stage_add uboot compile_uboot $uboot_cores "" "$UBOOT" \
+		"$UBOOT_BIN/uboot.img $UBOOT_BIN/trust.img $UBOOT_BIN/idbloader.img" \
+		"${PLATFORM}"
+	stage_add kernel compile_kernel $CORES "" "$LINUX" \
+		"$BUILD/kernel/boot.img" "${PLATFORM} ${BOARD}"
+	stage_add rootfs_setup setup_rootfs 1 "rootfs uboot kernel" "" ""
+
+	if [ -n "$1" ]; then
+		stage_add image build_image 1 "rootfs_setup" "" ""
+	fi
+}
@@ -20,10 +20,10 @@ apt-get -y install xorg xfce4 xfce4-goodies vlc network-manager-gnome
 
 # 清理不再需要的依赖包
 apt-get -y autoremove
-# 清理apt缓存以减小rootfs体积
-apt-get clean
 
 EOF
+        # 在主机上预下载桌面环境软件包
+        apt_host_prefetch < "$DEST/type-phase"
         # 给脚本添加执行权限
         chmod +x "$DEST/type-phase"
         # 在chroot环境中执行安装脚本
@@ -38,6 +38,27 @@ EOF
 
 # 安装LXDE桌面环境（比XFCE更轻量）
 install_lxde_desktop()
+{
+	# 复制DNS配置以支持网络安装
+	cp /etc/resolv.conf "$DEST/etc/resolv.conf"
+	# 在主机上预下载桌面环境软件包
+	lxde_desktop_phase | apt_host_prefetch
+	# 创建LXDE安装脚本
+	lxde_desktop_phase > "$DEST/type-phase"
+	# 给安装脚本添加执行权限
+	chmod +x "$DEST/type-phase"
+	# 在chroot环境中执行安装脚本
+ 	do_chroot /type-phase
+	# 同步文件系统
+	sync
+	# 清理临时文件
+	rm -f "$DEST/type-phase"
+	rm -f "$DEST/etc/resolv.conf"
+
+}
+
+# 输出LXDE桌面安装脚本（内容同时作为桌面版rootfs缓存key的一部分）
+lxde_desktop_phase()
 {
 	# 设置默认用户名
 	_user="orangepi"
@@ -49,10 +70,7 @@ install_lxde_desktop()
 	else
 		_DST=Debian
 	fi
-	# 复制DNS配置以支持网络安装
-	cp /etc/resolv.conf "$DEST/etc/resolv.conf"
-	# 创建LXDE安装脚本
-	cat > "$DEST/type-phase" <<EOF
+	cat <<EOF
 #!/bin/bash
 
 # 显示空行和当前日期
@@ -89,8 +107,6 @@ apt-get $_auto install lxde lightdm lightdm-gtk-greeter policykit-1 --no-install
 apt-get $_auto install net-tools
 # 安装LXDE会话注销工具
 apt-get $_auto install lxsession-logout
-# 清理apt缓存
-apt-get clean
 
 # Ubuntu发行版需要安装特定的图标主题
 if [ "${_DST}" = "Ubuntu" ] ; then
@@ -103,7 +119,6 @@ apt-get $_auto install pulseaudio pulseaudio-utils alsa-oss alsa-utils alsa-tool
 apt-get $_auto install smplayer
 # 安装系统工具：软件包管理器、任务管理器、计算器、认证代理
 apt-get $_auto install synaptic software-properties-gtk lxtask galculator policykit-1-gnome --no-install-recommends
-apt-get clean
 
 # === 安装网络组件和浏览器 ===========================================
 # === 如果不需要浏览器可以注释掉，可节省约100MB空间 ===
@@ -117,7 +132,6 @@ else
 fi
 # 安装NetworkManager的GNOME前端
 apt-get $_auto install network-manager-gnome
-apt-get clean
 
 
 # === 配置桌面环境 ===================================================
@@ -172,16 +186,6 @@ usermod -a -G adm,dialout,cdrom,dip,video,plugdev,netdev,fuse $_user
 chown -R $_user:$_user /home/$_user
 
 EOF
-	# 给安装脚本添加执行权限
-	chmod +x "$DEST/type-phase"
-	# 在chroot环境中执行安装脚本
- 	do_chroot /type-phase
-	# 同步文件系统
-	sync
-	# 清理临时文件
-	rm -f "$DEST/type-phase"
-	rm -f "$DEST/etc/resolv.conf"
-
 }
 
 # 使用debootstrap从零构建rootfs（适用于Debian系统）
@@ -195,13 +199,14 @@ deboostrap_rootfs() {
 
 	# 确保临时目录创建成功
 	[ "$TEMP" ] || exit 1
-	cd $TEMP && pwd
+	# 用pushd进入，每个返回路径都popd，避免调用者停留在$TEMP中
+	pushd $TEMP
 
 	# Debian归档密钥环包（用于验证软件包签名）
 	# 这个更新不频繁，所以硬编码URL是可以的
 	debian_archive_keyring_deb="${SOURCES}/pool/main/d/debian-archive-keyring/debian-archive-keyring_2019.1_all.deb"
 	# 下载密钥环包
-	wget -O keyring.deb "$debian_archive_keyring_deb"
+	wget -O keyring.deb "$debian_archive_keyring_deb" || { popd; return 1; }
 	# 解压deb包（ar是deb包的归档格式）
 	ar -x keyring.deb && rm -f control.tar.gz debian-binary && rm -f keyring.deb
 	# 检测数据压缩格式（可能是.gz, .xz等）
@@ -217,7 +222,7 @@ deboostrap_rootfs() {
 
 	# 使用qemu-debootstrap构建ARM64/ARMHF rootfs
 	# --arch指定目标架构，--keyring指定验证密钥
-	qemu-debootstrap --arch=${ARCH} --keyring=$TEMP/$KR $dist rootfs ${SOURCES}
+	qemu-debootstrap --arch=${ARCH} --keyring=$TEMP/$KR $dist rootfs ${SOURCES} || { popd; return 1; }
 	rm -f $KR
 
 	# 清理qemu静态二进制（稍后会重新复制）
@@ -230,14 +235,31 @@ deboostrap_rootfs() {
        fi
 
 	# 将rootfs打包成tar.gz
-	bsdtar -C $TEMP/rootfs -a -cf $tgz .
+	bsdtar -C $TEMP/rootfs -a -cf $tgz . || { popd; return 1; }
 	rm -fr $TEMP/rootfs
 
-	cd -
+	popd
 }
 
-# 在ARM rootfs中执行命令（通过chroot和QEMU模拟）
-do_chroot() {
+# 确定共享apt软件包缓存目录（按发行版和架构区分）
+# APT_CACHE已设置时保持不变；缺少发行版或架构时报错退出，避免绑定挂载空路径
+apt_cache_init()
+{
+	[ -n "$APT_CACHE" ] && return 0
+	if [ -z "$CACHE" ] || [ -z "$DISTRO" ] || [ -z "$ARCH" ]; then
+		echo -e "\e[1;31m APT_CACHE is not set (CACHE/DISTRO/ARCH unknown) \e[0m"
+		exit 1
+	fi
+	APT_CACHE="${CACHE}/apt/${DISTRO}-${ARCH}"
+}
+
+# 开始chroot会话：复制QEMU、挂载proc/sys和共享apt缓存（会话可嵌套，只有最外层真正挂载）
+# 会话期间多次do_chroot只执行命令，不再重复挂载/卸载
+chroot_session_begin()
+{
+	CHROOT_DEPTH=$((${CHROOT_DEPTH:-0} + 1))
+	[ $CHROOT_DEPTH -gt 1 ] && return 0
+
 	# 复制QEMU静态二进制到rootfs，使x86_64主机可以执行ARM二进制
 	# QEMU用户态模拟允许在非ARM平台上执行ARM程序
 #	cp /usr/bin/qemu-arm-static "$DEST/usr/bin"
@@ -249,22 +271,85 @@ do_chroot() {
                cp /usr/bin/qemu-arm-static "$DEST/usr/bin"
        fi
 
-	# 获取要执行的命令参数
-	cmd="$@"
 	# 挂载proc文件系统（进程信息，很多程序依赖）
 	chroot "$DEST" mount -t proc proc /proc || true
 	# 挂载sys文件系统（设备和内核信息）
 	chroot "$DEST" mount -t sysfs sys /sys || true
-	# 在chroot环境中执行命令
-	chroot "$DEST" $cmd
+	# 绑定挂载主机端共享的apt软件包缓存，.deb在多次构建之间复用
+	# 缓存不属于rootfs，卸载后镜像中的/var/cache/apt/archives仍为空
+	apt_cache_init
+	mkdir -p "$APT_CACHE/partial" "$DEST/var/cache/apt/archives"
+	mount --bind "$APT_CACHE" "$DEST/var/cache/apt/archives"
+}
+
+# 结束chroot会话：卸载文件系统并清理
+chroot_session_end()
+{
+	CHROOT_DEPTH=$((${CHROOT_DEPTH:-1} - 1))
+	[ $CHROOT_DEPTH -gt 0 ] && return 0
+
 	# 卸载文件系统
+	umount "$DEST/var/cache/apt/archives"
 	chroot "$DEST" umount /sys
 	chroot "$DEST" umount /proc
+	# 删除apt的包索引缓存（原先由apt-get clean完成）
+	rm -f "$DEST"/var/cache/apt/*.bin
 
 	# 清理QEMU二进制文件
 	rm -f "$DEST/usr/bin/qemu-arm-static"
 }
 
+# 在ARM rootfs中执行命令（通过chroot和QEMU模拟）
+# 不在会话中时，自动为这一条命令开始并结束一个会话
+# 返回: 命令在chroot中的退出状态
+do_chroot() {
+	# 获取要执行的命令参数
+	cmd="$@"
+	local rc=0
+	chroot_session_begin
+	# 在chroot环境中执行命令
+	chroot "$DEST" $cmd || rc=$?
+	chroot_session_end
+	return $rc
+}
+
+# 在主机上以原生速度预下载chroot脚本要安装的软件包到共享apt缓存
+# 使用主机的apt-get，但软件源、密钥、包索引和dpkg状态都取自目标rootfs，
+# 这样依赖解析结果与chroot中一致，chroot中只剩解包和配置需要QEMU模拟
+# 用法: <脚本内容> | apt_host_prefetch
+apt_host_prefetch()
+{
+	apt_cache_init
+	local apt_arch=$ARCH
+	[ $ARCH = "arm" ] && apt_arch=armhf
+	local opts="-o APT::Architecture=${apt_arch} \
+		-o APT::Architectures::=${apt_arch} \
+		-o Dir::Etc::SourceList=$DEST/etc/apt/sources.list \
+		-o Dir::Etc::SourceParts=$DEST/etc/apt/sources.list.d \
+		-o Dir::Etc::Trusted=$DEST/etc/apt/trusted.gpg \
+		-o Dir::Etc::TrustedParts=$DEST/etc/apt/trusted.gpg.d \
+		-o Dir::Etc::Preferences=$DEST/etc/apt/preferences \
+		-o Dir::Etc::PreferencesParts=$DEST/etc/apt/preferences.d \
+		-o Dir::State=$DEST/var/lib/apt \
+		-o Dir::State::status=$DEST/var/lib/dpkg/status \
+		-o Dir::Cache=$DEST/var/cache/apt \
+		-o Dir::Cache::archives=$APT_CACHE \
+		-o APT::Sandbox::User=root \
+		-o Debug::NoLocking=1"
+
+	mkdir -p "$APT_CACHE/partial"
+	apt-get $opts update || return 0
+	# 逐行处理脚本中的 "apt-get ... install ..."（续行先合并），每行单独尝试，
+	# 失败（如另一发行版分支中的包名）不影响构建，chroot中的安装仍以脚本为准
+	sed -e ':a' -e '/\\$/N; s/\\\n//; ta' | \
+		sed -n 's/^[[:space:]]*apt-get \(.*install .*\)$/\1/p' | \
+		while read -r args; do
+			apt-get $opts -y -q --download-only $args < /dev/null || true
+		done
+	# 删除主机apt生成的包索引缓存（格式可能与目标rootfs中的apt版本不兼容）
+	rm -f "$DEST"/var/cache/apt/*.bin
+}
+
 # 复制平台相关的配置文件和工具到rootfs
 do_conffile() {
         # 创建boot目录用于存放启动文件
@@ -459,6 +544,27 @@ deb-src ${SOURCES} ${release}-backports main restricted universe multiverse
 EOF
 }
 
+# 清理函数（脚本或构建阶段退出时执行）：卸载chroot中残留的挂载、删除临时目录
+rootfs_cleanup()
+{
+	# 卸载可能挂载的proc文件系统
+	if [ -e "$DEST/proc/cmdline" ]; then
+		umount "$DEST/proc"
+	fi
+	# 卸载可能挂载的sys文件系统
+	if [ -d "$DEST/sys/kernel" ]; then
+		umount "$DEST/sys"
+	fi
+	# 卸载共享apt缓存
+	if mountpoint -q "$DEST/var/cache/apt/archives"; then
+		umount "$DEST/var/cache/apt/archives"
+	fi
+	# 清理临时目录
+	if [ -d "$TEMP" ]; then
+		rm -rf "$TEMP"
+	fi
+}
+
 # 准备构建环境（检查目标目录、配置软件源、下载base rootfs）
 prepare_env()
 {
@@ -476,23 +582,18 @@ prepare_env()
 		rm -rf $DEST
 	fi
 
-	# 定义清理函数（脚本退出时自动执行）
-	cleanup() {
-		# 卸载可能挂载的proc文件系统
-		if [ -e "$DEST/proc/cmdline" ]; then
-			umount "$DEST/proc"
-		fi
-		# 卸载可能挂载的sys文件系统
-		if [ -d "$DEST/sys/kernel" ]; then
-			umount "$DEST/sys"
-		fi
-		# 清理临时目录
-		if [ -d "$TEMP" ]; then
-			rm -rf "$TEMP"
-		fi
-	}
-	# 注册EXIT陷阱，脚本退出时自动执行cleanup
-	trap cleanup EXIT
+	# 注册EXIT陷阱，脚本退出时自动执行清理
+	trap rootfs_cleanup EXIT
+
+	rootfs_select_sources
+}
+
+# 根据发行版确定软件源、base rootfs下载地址、共享apt缓存和各层缓存key
+# 并行构建时在主shell中（add_build_stages）执行，各阶段子shell继承结果；
+# SOURCES会从地区名改写为URL，所以只执行一次
+rootfs_select_sources()
+{
+	[ -n "$ROOTFS_BASE_KEY" ] && return 0
 
 	# 根据发行版选择软件源和base rootfs下载地址
 	case $DISTRO in
@@ -556,17 +657,57 @@ prepare_env()
 			;;
 	esac
 
-	# 确定rootfs tarball的本地路径
-	TARBALL="$EXTER/$(basename $ROOTFS)"
+	# 共享apt软件包缓存（按发行版和架构区分）
+	APT_CACHE=""
+	apt_cache_init
+
+	# 计算各层rootfs的缓存key（base -> server -> desktop，上层key包含下层key）
+	rootfs_cache_keys
+}
+
+# 计算rootfs各层缓存key
+# base:    发行版、架构、构建方式、下载地址、软件源及快照标识，
+#          debootstrap方式还包括构建脚本本身（密钥环包地址等）
+# server:  base key + 第二阶段安装脚本（软件包列表）
+# desktop: server key + 桌面安装脚本
+rootfs_cache_keys()
+{
+	local recipe=""
+	[ "$METHOD" = "debootstrap" ] && recipe=$(declare -f deboostrap_rootfs)
+	ROOTFS_BASE_KEY=$(cache_key "$DISTRO" "$ARCH" "$METHOD" "$ROOTFS" "$SOURCES" "$ROOTFS_SNAPSHOT" "$recipe")
+	rootfs_server_vars
+	ROOTFS_SERVER_KEY=$(cache_key "$ROOTFS_BASE_KEY" "$(server_second_phase)")
+	ROOTFS_DESKTOP_KEY=$(cache_key "$ROOTFS_SERVER_KEY" "$(lxde_desktop_phase)")
+}
+
+# 解压base rootfs到目标目录（tarball不在缓存中时先下载或debootstrap）
+prepare_base_rootfs()
+{
+	# rootfs tarball按缓存key存放，软件源或快照变化时重新获取
+	TARBALL="${CACHE}/rootfs/${DISTRO}-base-${ARCH}-${ROOTFS_BASE_KEY}.tar.gz"
+	# 下载/构建过程中的临时文件（保留.tar.gz后缀，bsdtar -a据此选择压缩格式）
+	local partial="${TARBALL%.tar.gz}.part.tar.gz"
+	mkdir -p ${CACHE}/rootfs
 	# 如果tarball不存在，下载或构建
 	if [ ! -e "$TARBALL" ]; then
 		if [ "$METHOD" = "download" ]; then
 			# Ubuntu使用下载预构建的base rootfs
 			echo "Downloading $DISTRO rootfs tarball ..."
-			wget -O "$TARBALL" "$ROOTFS"
+			# 先下载到临时文件，成功后再改名，避免不完整的tarball进入缓存
+			if ! wget -O "$partial" "$ROOTFS"; then
+				rm -f "$partial"
+				echo "Download $ROOTFS failed"
+				exit 1
+			fi
+			mv -f "$partial" "$TARBALL"
 		elif [ "$METHOD" = "debootstrap" ]; then
 			# Debian使用debootstrap从零构建
-			deboostrap_rootfs "$DISTRO" "$TARBALL"
+			if ! deboostrap_rootfs "$DISTRO" "$partial"; then
+				rm -f "$partial"
+				echo "Debootstrap $DISTRO rootfs failed"
+				exit 1
+			fi
+			mv -f "$partial" "$TARBALL"
 		else
 			echo "Unknown rootfs creation method"
 			exit 1
@@ -587,6 +728,30 @@ prepare_rootfs_server()
 	# 删除旧的resolv.conf，复制宿主机的DNS配置
 	rm "$DEST/etc/resolv.conf"
 	cp /etc/resolv.conf "$DEST/etc/resolv.conf"
+	rootfs_server_vars
+	# 添加对应发行版的软件源配置
+	add_${DEB}_apt_sources $DISTRO
+	# 删除proposed源（测试版软件源）
+	rm -rf "$DEST/etc/apt/sources.list.d/proposed.list"
+	# 在主机上预下载第二阶段要安装的软件包
+	server_second_phase | apt_host_prefetch
+	# 创建第二阶段安装脚本（在chroot环境中执行）
+	server_second_phase > "$DEST/second-phase"
+	# 给脚本添加执行权限
+	chmod +x "$DEST/second-phase"
+	# 在chroot环境中执行第二阶段安装
+	do_chroot /second-phase
+	# 清理临时文件
+	rm -f "$DEST/second-phase"
+        rm -f "$DEST/etc/resolv.conf"
+
+	# 保存服务器版rootfs到缓存（可复用，加速后续构建）
+	cache_save $(cache_path rootfs ${DISTRO}_server ${ROOTFS_SERVER_KEY}) $DEST
+}
+
+# 根据发行版设置服务器版rootfs的用户和额外软件包
+rootfs_server_vars()
+{
 	# 根据发行版设置不同的配置
 	if [ "$DISTRO" = "xenial" -o "$DISTRO" = "bionic" ]; then
 		DEB=ubuntu
@@ -606,12 +771,12 @@ prepare_rootfs_server()
 		echo "Unknown DISTRO=$DISTRO"
 		exit 2
 	fi
-	# 添加对应发行版的软件源配置
-	add_${DEB}_apt_sources $DISTRO
-	# 删除proposed源（测试版软件源）
-	rm -rf "$DEST/etc/apt/sources.list.d/proposed.list"
-	# 创建第二阶段安装脚本（在chroot环境中执行）
-	cat > "$DEST/second-phase" <<EOF
+}
+
+# 输出第二阶段安装脚本（内容同时作为服务器版rootfs缓存key的一部分）
+server_second_phase()
+{
+	cat <<EOF
 #!/bin/bash
 # 非交互式安装
 export DEBIAN_FRONTEND=noninteractive
@@ -658,20 +823,7 @@ usermod -a -G video $DEBUSER     # 视频设备
 usermod -a -G plugdev $DEBUSER   # 可插拔设备
 # 清理
 apt-get -y autoremove
-apt-get clean
 EOF
-	# 给脚本添加执行权限
-	chmod +x "$DEST/second-phase"
-	# 在chroot环境中执行第二阶段安装
-	do_chroot /second-phase
-	# 清理临时文件
-	rm -f "$DEST/second-phase"
-        rm -f "$DEST/etc/resolv.conf"
-
-	# 打包服务器版rootfs为tar.gz（可复用，加速后续构建）
-	cd $BUILD
-	tar czf ${DISTRO}_server_rootfs.tar.gz rootfs
-	cd -
 }
 
 # 准备桌面版rootfs（在服务器版基础上安装桌面环境）
@@ -679,10 +831,8 @@ prepare_rootfs_desktop()
 {
 	# 安装LXDE桌面环境
 	install_lxde_desktop
-	# 打包桌面版rootfs
-	cd $BUILD
-	tar czf ${DISTRO}_desktop_rootfs.tar.gz rootfs
-	cd -
+	# 保存桌面版rootfs到缓存
+	cache_save $(cache_path rootfs ${DISTRO}_desktop ${ROOTFS_DESKTOP_KEY}) $DEST
 
 }
 
@@ -806,48 +956,52 @@ desktop_setup()
 
 }
 
-# 构建rootfs的主函数（根据TYPE选择构建服务器版或桌面版）
-build_rootfs()
+# 构建rootfs各层（base/server/desktop，不依赖内核和U-Boot，可与编译并行执行）
+# 各层rootfs按内容缓存，命中时跳过debootstrap和模拟环境中的apt安装
+build_rootfs_layers()
 {
-	# 准备基础环境（下载/解压base rootfs）
+	# 准备基础环境（清理目标目录、选择软件源、计算缓存key）
 	prepare_env
 
 	# TYPE=1表示桌面版，TYPE=0表示服务器版
 	if [ $TYPE = "1" ]; then
-		# 构建桌面版rootfs
-		if [ -f $BUILD/${DISTRO}_desktop_rootfs.tar.gz ]; then
-			# 如果已有打包好的桌面版，直接解压使用
-			rm -rf $DEST
-			tar zxf $BUILD/${DISTRO}_desktop_rootfs.tar.gz -C $BUILD
-		else
-			# 否则需要先构建桌面版
-			if [ -f $BUILD/${DISTRO}_server_rootfs.tar.gz ]; then
-				# 如果有服务器版，在其基础上安装桌面环境
-				rm -rf $DEST
-				tar zxf $BUILD/${DISTRO}_server_rootfs.tar.gz -C $BUILD
-				prepare_rootfs_desktop
-			else
+		# 构建桌面版rootfs：优先使用缓存的桌面版
+		if ! cache_restore $(cache_path rootfs ${DISTRO}_desktop ${ROOTFS_DESKTOP_KEY}) $DEST; then
+			# 其次在缓存的服务器版基础上安装桌面环境
+			if ! cache_restore $(cache_path rootfs ${DISTRO}_server ${ROOTFS_SERVER_KEY}) $DEST; then
 				# 从零开始：先构建服务器版，再安装桌面环境
+				prepare_base_rootfs
 				prepare_rootfs_server
-				prepare_rootfs_desktop
-
 			fi
+			prepare_rootfs_desktop
 		fi
-		# 执行服务器配置和桌面配置
-		server_setup
-		desktop_setup
 	else
-		# 构建服务器版rootfs
-		if [ -f $BUILD/${DISTRO}_server_rootfs.tar.gz ]; then
-			# 如果已有打包好的服务器版，直接解压使用
-			rm -rf $DEST
-			tar zxf $BUILD/${DISTRO}_server_rootfs.tar.gz -C $BUILD
-		else
-			# 否则从零开始构建服务器版
+		# 构建服务器版rootfs：缓存未命中时从零开始构建
+		if ! cache_restore $(cache_path rootfs ${DISTRO}_server ${ROOTFS_SERVER_KEY}) $DEST; then
+			prepare_base_rootfs
 			prepare_rootfs_server
 		fi
-		# 执行服务器配置
-		server_setup
 	fi
 }
 
+# rootfs系统配置（安装内核模块、U-Boot和内核镜像，依赖编译结果）
+setup_rootfs()
+{
+	apt_cache_init
+	trap rootfs_cleanup EXIT
+
+	# 在同一个chroot会话中执行服务器配置（桌面版再执行桌面配置）
+	chroot_session_begin
+	server_setup
+	if [ $TYPE = "1" ]; then
+		desktop_setup
+	fi
+	chroot_session_end
+}
+
+# 构建rootfs的主函数（根据TYPE选择构建服务器版或桌面版）
+build_rootfs()
+{
+	build_rootfs_layers
+	setup_rootfs
+}
@@ -80,7 +80,9 @@ prepare_host()
 		        gcc automake make binfmt-support flex \
 		        lib32z1 lib32z1-dev qemu-user-static bison \
 		        dosfstools libncurses5-dev debootstrap \
-		        swig libpython2.7-dev libssl-dev python-minimal dos2unix
+		        swig libpython2.7-dev libssl-dev python-minimal dos2unix \
+		        zstd xz-utils unzip cmake pkg-config libtool autoconf \
+		        autopoint gettext gtk-doc-tools ccache
 
 	# Prepare toolchains
 	chmod 755 -R $ROOT/toolchain/*
@@ -132,13 +134,87 @@ kernel_update()
 	whiptail --title "OrangePi Build System" --msgbox "Succeed to update kernel" 10 60
 }
 
-modules_update()
+# 增量同步目录树：只复制新增或变化的文件，删除源目录中已不存在的文件
+# 大小和修改时间都相同的文件直接跳过；只有修改时间不同的文件比较内容，
+# 内容相同时保留目标文件的修改时间（源目录每次重新生成时修改时间总是更新，
+# 若同步过去，之后按修改时间判断的同步会把所有文件视为已变化）。
+# 复制优先使用 reflink，先写临时文件再改名，中断时不会留下半个文件
+# 用法: sync_tree <源目录> <目标目录> [排除的相对路径 (awk 正则)]
+sync_tree()
+{
+	local src="$1"
+	local dst="$2"
+	local skip="${3:-^\$}"
+	local op f copied=0 skipped=0 removed=0
+
+	mkdir -p "$dst"
+	while IFS=$'\t' read -r op f; do
+		case "$op" in
+			"chk")
+				if [ -L "$src/$f" ]; then
+					if [ "$(readlink "$src/$f")" = "$(readlink "$dst/$f")" ]; then
+						skipped=$((skipped + 1))
+						continue
+					fi
+				elif [ -f "$dst/$f" -a ! -L "$dst/$f" ] && cmp -s "$src/$f" "$dst/$f"; then
+					skipped=$((skipped + 1))
+					continue
+				fi
+				;&
+			"new")
+				mkdir -p "$(dirname "$dst/$f")"
+				cp -P --reflink=auto --preserve=mode,timestamps "$src/$f" "$dst/$f.sync-tmp"
+				mv -f "$dst/$f.sync-tmp" "$dst/$f"
+				copied=$((copied + 1))
+				;;
+			"del")
+				rm -f "$dst/$f"
+				removed=$((removed + 1))
+				;;
+		esac
+	done < <(awk -F'\t' -v skip="$skip" '
+		$1 ~ skip { next }
+		FILENAME == ARGV[1] { d[$1] = $2; next }
+		{
+			if (!($1 in d))
+				print "new\t" $1
+			else if (d[$1] != $2)
+				print "chk\t" $1
+			delete d[$1]
+		}
+		END { for (f in d) print "del\t" f }' \
+		<(find "$dst" -mindepth 1 -not -type d -printf '%P\t%y %s %T@\n') \
+		<(find "$src" -mindepth 1 -not -type d -printf '%P\t%y %s %T@\n'))
+
+	find "$dst" -mindepth 1 -depth -type d -empty -delete
+	echo "Synced $src -> $dst: $copied copied, $removed removed, $skipped unchanged"
+}
+
+# 增量同步内核模块 (<根目录>/lib/modules)，最后对每个内核版本执行一次 depmod
+# depmod 生成的索引文件不参与同步，由 depmod 在目标目录重新生成
+# 用法: sync_modules <源根目录> <目标根目录>
+sync_modules()
 {
+	local ver
 
-	# Remove old modules
-	rm -rf $ROOTFS_PATH/lib/modules
+	# 源目录中已不存在的内核版本整体删除 (其中的 depmod 索引不参与同步)
+	for ver in $(ls "$2/lib/modules" 2>/dev/null); do
+		[ -d "$1/lib/modules/$ver" ] || rm -rf "$2/lib/modules/$ver"
+	done
+
+	sync_tree "$1/lib/modules" "$2/lib/modules" \
+		'^[^/]+/modules\.(dep|alias|symbols|softdep|devname|builtin\.alias)|^[^/]+/modules\..*\.bin$'
+
+	for ver in $(ls "$2/lib/modules"); do
+		depmod -a -b "$2" $ver
+	done
+}
+
+modules_update()
+{
 
-	cp -rfa $BUILD/lib/modules $ROOTFS_PATH/lib/
+	# 只更新变化的模块，未变化的文件不重写
+	sync_modules $BUILD $ROOTFS_PATH
 
 	sync
 	clear
@@ -111,7 +111,6 @@ apt update
 apt-get -y build-dep xserver-xorg-core
 cp -rfa /packages/xserver/xserver_for_bionic/* / 
 
-apt-get clean
 rm -rf /tmp/*
 EOF
 	elif [ $DISTRO = "xenial" -o $DISTRO = "stretch" ]; then
@@ -129,7 +128,6 @@ apt-get -y install libxcb-xkb-dev libxfont-dev wayland-protocols
 
 cp -rfa /packages/xserver/xserver_for_$DISTRO/* /
 
-apt-get clean
 EOF
 
 fi
@@ -140,78 +138,138 @@ fi
 }
 
 
-compile_gst()
+# 交叉编译环境：使用主机上的 aarch64 工具链，以 rootfs ($DEST) 作为 sysroot
+# rootfs 中已由 install_gstreamer 安装好各 -dev 包和 gstreamer 1.14.4，
+# pkg-config/aclocal 均指向 sysroot，头文件和库不会误用主机上的版本
+gst_cross_env()
 {
-	cat > "$DEST/type-phase" << EOF
-#!/bin/bash -e
-
-cd /packages/source
-mkdir -p /opt/build
-
-if [ $DISTRO = "xenial" -o $DISTRO = "stretch" ]; then
-# install orc
-tar -xvf orc-0.4.25.tar
-cd orc-0.4.25
-./autogen.sh --prefix=/usr
-make
-make install
-cd -
-
-# install  xorg-macros 1.12
-# wget https://www.x.org/archive/individual/util/util-macros-1.12.0.tar.gz
-tar -xvf util-macros-1.12.0.tar.gz
-cd util-macros-1.12.0
-./configure --prefix=/usr
-make
-make install
-cd -
-
-else
-#install orc
-tar -xvf orc-0.4.28.tar.xz
-cd orc-0.4.28
-./autogen.sh --prefix=/usr --disable-gtk-doc
-make
-make install
-cd -
-
-fi
-
-unzip libdrm-rockchip-rockchip-2.4.74.zip
-cd libdrm-rockchip-rockchip-2.4.74
-./autogen.sh --prefix=/usr 
-make
-make install
-make install DESTDIR=/opt/build/
-cd -
-
-#git clone https://github.com/rockchip-linux/mpp.git
-unzip mpp-release.zip
-cd mpp-release/build/linux/aarch64
-./make-Makefiles.bash
-make
-make install
-make install DESTDIR=/opt/build/
-cd -
+	local triplet=aarch64-linux-gnu
+
+	export CC="${TOOLS}gcc --sysroot=$DEST"
+	export CXX="${TOOLS}g++ --sysroot=$DEST"
+	export AR=${TOOLS}ar
+	export RANLIB=${TOOLS}ranlib
+	export STRIP=${TOOLS}strip
+	# Debian/Ubuntu 的 multiarch 目录不在工具链默认搜索路径中
+	export CPPFLAGS="-isystem $DEST/usr/include/$triplet"
+	# $GST_LINKS（见 sysroot_fix_links）排在最前，优先于 sysroot 中的绝对路径链接
+	export LDFLAGS="-B$DEST/usr/lib/$triplet -L$GST_LINKS/lib/$triplet -L$GST_LINKS/usr/lib/$triplet \
+		-L$DEST/lib/$triplet -L$DEST/usr/lib/$triplet \
+		-Wl,-rpath-link,$DEST/lib/$triplet -Wl,-rpath-link,$DEST/usr/lib/$triplet \
+		-Wl,-rpath-link,$DEST/usr/lib"
+	export PKG_CONFIG_SYSROOT_DIR=$DEST
+	export PKG_CONFIG_LIBDIR=$DEST/usr/lib/$triplet/pkgconfig:$DEST/usr/lib/pkgconfig:$DEST/usr/share/pkgconfig
+	export ACLOCAL_PATH=$DEST/usr/share/aclocal
+	GST_HOST="--host=$triplet --prefix=/usr --with-sysroot=$DEST"
+}
 
-#git clone https://github.com/rockchip-linux/gstreamer-rockchip.git
-unzip gstreamer-rockchip.zip
-cd gstreamer-rockchip-master
-./autogen.sh --prefix=/usr --enable-gst --disable-rkximage
-make 
-make install DESTDIR=/opt/build/
-cd -
+# sysroot 中指向绝对路径的库符号链接（如 libm.so -> /lib/...）在主机上会指向主机的库
+# 不修改 rootfs 本身，而是在 $1 下按相同目录结构建立指向 sysroot 内文件的链接，
+# 链接时该目录的 -L 排在 sysroot 之前
+sysroot_fix_links()
+{
+	local dir=$1
+	local link target
+
+	GST_LINKS=$dir
+	find $DEST/usr/lib $DEST/lib -lname '/*' -name '*.so*' 2>/dev/null | while read link; do
+		target=$(readlink $link)
+		mkdir -p "$dir$(dirname ${link#$DEST})"
+		ln -sf "$DEST$target" "$dir${link#$DEST}"
+	done
+}
 
+# 在主机上交叉编译 orc、libdrm-rockchip、mpp 和 gstreamer-rockchip(-extra)
+# DESTDIR=$DEST 相当于原先在 chroot 中的 make install（后续包依赖它们），
+# DESTDIR=$DEST/opt/build 为打包缓存的产物
+compile_gst()
+{
+	local src=$DEST/packages/source
+	local work=$BUILD/gst_cross
+	local out=$DEST/opt/build
+
+	rm -rf $work
+	mkdir -p $work $out
+	sysroot_fix_links $work/links
+
+	# 放在 if/|| 中的子 shell 会忽略 set -e，因此在后台执行，再用 wait 取得退出状态
+	(
+	set -e
+	gst_cross_env
+	cd $work
+
+	if [ $DISTRO = "xenial" -o $DISTRO = "stretch" ]; then
+		# install orc
+		tar -xf $src/orc-0.4.25.tar
+		cd orc-0.4.25
+		./autogen.sh $GST_HOST
+		make -j${CORES}
+		make install DESTDIR=$DEST
+		cd $work
+
+		# install  xorg-macros 1.12
+		tar -xf $src/util-macros-1.12.0.tar.gz
+		cd util-macros-1.12.0
+		./configure $GST_HOST
+		make install DESTDIR=$DEST
+		cd $work
+	else
+		# install orc
+		tar -xf $src/orc-0.4.28.tar.xz
+		cd orc-0.4.28
+		./autogen.sh $GST_HOST --disable-gtk-doc
+		make -j${CORES}
+		make install DESTDIR=$DEST
+		cd $work
+	fi
 
-# git clone https://github.com/rockchip-linux/gstreamer-rockchip-extra.git
-unzip gstreamer-rockchip-extra.zip
-cd gstreamer-rockchip-extra-master
-./autogen.sh --prefix=/usr --enable-gst --enable-rkximage
-make
-make install DESTDIR=/opt/build/
-cd -
+	unzip -q $src/libdrm-rockchip-rockchip-2.4.74.zip
+	cd libdrm-rockchip-rockchip-2.4.74
+	./autogen.sh $GST_HOST
+	make -j${CORES}
+	make install DESTDIR=$DEST
+	make install DESTDIR=$out
+	cd $work
+
+	# mpp 自带的 make-Makefiles.bash 写死了工具链路径，直接用 cmake 指定交叉编译参数
+	unzip -q $src/mpp-release.zip
+	mkdir -p mpp-release/build/cross
+	cd mpp-release/build/cross
+	cmake -DCMAKE_SYSTEM_NAME=Linux -DCMAKE_SYSTEM_PROCESSOR=aarch64 \
+		-DCMAKE_C_COMPILER=${TOOLS}gcc -DCMAKE_CXX_COMPILER=${TOOLS}g++ \
+		-DCMAKE_SYSROOT=$DEST -DCMAKE_INSTALL_PREFIX=/usr \
+		-DCMAKE_BUILD_TYPE=Release -DRKPLATFORM=ON -DHAVE_DRM=ON ../..
+	make -j${CORES}
+	make install DESTDIR=$DEST
+	make install DESTDIR=$out
+	cd $work
+
+	unzip -q $src/gstreamer-rockchip.zip
+	cd gstreamer-rockchip-master
+	./autogen.sh $GST_HOST --enable-gst --disable-rkximage
+	make -j${CORES}
+	make install DESTDIR=$out
+	cd $work
+
+	unzip -q $src/gstreamer-rockchip-extra.zip
+	cd gstreamer-rockchip-extra-master
+	./autogen.sh $GST_HOST --enable-gst --enable-rkximage
+	make -j${CORES}
+	make install DESTDIR=$out
+	cd $work
+	) &
+	if ! wait $!; then
+		rm -rf $work
+		echo -e "\e[1;31m Cross compiling gstreamer components failed \e[0m"
+		exit 1
+	fi
+	rm -rf $work
 
+	# camera_engine_rkisp 的 Makefile 不支持 sysroot，仍在 chroot 中编译
+	cat > "$DEST/type-phase" << EOF
+#!/bin/bash -e
 
+cd /packages/source
 
 # git clone https://github.com/rockchip-linux/camera_engine_rkisp.git
 tar -xf camera_engine_rkisp.tar.xz
@@ -238,15 +296,31 @@ cp /packages/test.mp4 /opt/build/usr/local/
 
 EOF
 	chmod +x "$DEST/type-phase"
- 	do_chroot /type-phase
+	if ! do_chroot /type-phase; then
+		rm -f "$DEST/type-phase"
+		echo -e "\e[1;31m Building camera_engine_rkisp failed \e[0m"
+		exit 1
+	fi
 	sync
 	rm -f "$DEST/type-phase"
 	
-	rm -rf $BUILD/build
-	mv $DEST/opt/build $BUILD
-	cd $BUILD
-	tar czf build_for_${DISTRO}.tar.gz build
-        cd -
+	# 全部编译成功后，产物目录树才移入缓存
+	cache_tree_save $DEST/opt/build $GST_CACHE
+}
+
+# 多媒体组件缓存 key：源码包内容、发行版、交叉工具链版本，以及编译脚本本身
+# （编译脚本决定 sysroot 中的依赖包和编译参数）
+gst_cache_key()
+{
+	local src=$EXTER/packages/source
+
+	cache_key "$DISTRO" "$(${TOOLS}gcc --version 2>/dev/null | head -1)" \
+		"$(cache_file_key $src/orc-0.4.25.tar $src/orc-0.4.28.tar.xz \
+			$src/util-macros-1.12.0.tar.gz \
+			$src/libdrm-rockchip-rockchip-2.4.74.zip $src/mpp-release.zip \
+			$src/gstreamer-rockchip.zip $src/gstreamer-rockchip-extra.zip \
+			$src/camera_engine_rkisp.tar.xz $EXTER/packages/test.mp4)" \
+		"$(declare -f install_gstreamer compile_gst gst_cross_env sysroot_fix_links)"
 }
 install_gstreamer()
 {
@@ -275,7 +349,6 @@ tar xzf /packages/others/gstreamer/gst-plugins-ugly-1.14.4.tar.gz -C /
 tar xzf /packages/others/gstreamer/gst-libav-1.14.4.tar.gz -C /
 
 
-apt-get clean
 EOF
 
 	
@@ -308,21 +381,21 @@ tar xzf /packages/others/gstreamer/gst-plugins-bad-1.14.4.tar.gz -C /
 tar xzf /packages/others/gstreamer/gst-plugins-ugly-1.14.4.tar.gz -C /
 tar xzf /packages/others/gstreamer/gst-libav-1.14.4.tar.gz -C /
 
-apt-get clean
 EOF
 
 	fi
+	apt_host_prefetch < "$DEST/type-phase"
 	chmod +x "$DEST/type-phase"
  	do_chroot /type-phase
 	sync
 	rm -f "$DEST/type-phase"
 
-	if [ ! -f $BUILD/build_for_${DISTRO}.tar.gz ]; then
+	# 按内容缓存编译结果，源码包、工具链或编译脚本变化时重新编译
+	GST_CACHE=${CACHE}/gst/${DISTRO}-$(gst_cache_key)
+	if [ ! -d $GST_CACHE ]; then
 		compile_gst
 	fi
-	rm -rf $BUILD/build
-	tar zxf $BUILD/build_for_${DISTRO}.tar.gz -C $BUILD
-	cp -rfa $BUILD/build/* $DEST/ 
+	cache_tree_apply $GST_CACHE $DEST
 
 	if [ $DISTRO = "bionic" ]; then 
 		cp $DEST/usr/lib/gstreamer-1.0/* $DEST/usr/lib/aarch64-linux-gnu/gstreamer-1.0/ -rfa
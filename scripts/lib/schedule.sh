@@ -0,0 +1,153 @@
+#!/bin/bash
+
+###############################################################################
+# schedule.sh - 构建阶段调度库
+# 功能：各构建阶段声明依赖、输入和输出，无依赖关系的阶段并行执行，
+#       总并行度受 $CORES 限制；输出已是最新的阶段直接跳过
+#
+# 用法:
+#   stage_add <名称> <函数> <核数> "<依赖阶段>" "<输入路径>" "<输出路径>" ["<签名>"]
+#   run_stages
+#
+# 核数:   阶段最多占用的 CPU 核数，启动时作为该阶段的 $CORES（即 make -j 的值），
+#         空闲核数不足时按剩余核数启动（至少 1 个）
+# 签名:   影响产物但不体现在文件中的配置（如 BOARD），变化时阶段重新执行
+# 最新:   签名相同、输出全部存在，且输入和依赖阶段都没有比上次完成时间更新的文件
+#         输入为空的阶段每次都执行（由阶段自身的缓存保证速度）
+#
+# 执行:   阶段函数在 set -e 的子 shell 中执行，任一命令失败即视为阶段失败；
+#         阶段中设置的变量不会传给其他阶段，共用的变量需在 run_stages 之前确定
+#
+# 每个阶段的输出记录在 $BUILD/logs/<名称>.log，完成标记在 $BUILD/.stages/<名称>
+###############################################################################
+
+STAGES=()
+declare -A STAGE_FUNC STAGE_SLOTS STAGE_DEPS STAGE_INPUTS STAGE_OUTPUTS STAGE_SIG
+
+stage_add()
+{
+	STAGES+=("$1")
+	STAGE_FUNC[$1]="$2"
+	STAGE_SLOTS[$1]="$3"
+	STAGE_DEPS[$1]="$4"
+	STAGE_INPUTS[$1]="$5"
+	STAGE_OUTPUTS[$1]="$6"
+	STAGE_SIG[$1]="$7"
+}
+
+# 判断阶段是否已是最新（见文件头说明）
+stage_uptodate()
+{
+	local name=$1
+	local stamp="${BUILD}/.stages/${name}"
+	local f
+
+	[ -n "${STAGE_INPUTS[$name]}" ] || return 1
+	[ -f "$stamp" ] || return 1
+	[ "$(cat $stamp)" = "${STAGE_SIG[$name]}" ] || return 1
+
+	for f in ${STAGE_OUTPUTS[$name]}; do
+		[ -e "$f" ] || return 1
+	done
+	for f in ${STAGE_DEPS[$name]}; do
+		[ "${BUILD}/.stages/$f" -nt "$stamp" ] && return 1
+	done
+	for f in ${STAGE_INPUTS[$name]}; do
+		[ -n "$(find $f -newer $stamp -print -quit 2>/dev/null)" ] && return 1
+	done
+
+	return 0
+}
+
+# 按依赖关系并行执行所有已添加的阶段，任一阶段失败时终止其余阶段并退出
+run_stages()
+{
+	local -A state pid slots
+	local total=${CORES}
+	local free=${CORES}
+	local name dep ready launched running pending rc n
+
+	mkdir -p ${BUILD}/logs ${BUILD}/.stages
+	for name in "${STAGES[@]}"; do
+		state[$name]="pending"
+	done
+
+	while true; do
+		# 启动所有依赖已完成的阶段
+		launched=1
+		while [ $launched = 1 ]; do
+			launched=0
+			for name in "${STAGES[@]}"; do
+				[ "${state[$name]}" = "pending" ] || continue
+				ready=1
+				for dep in ${STAGE_DEPS[$name]}; do
+					[ "${state[$dep]}" = "done" ] || ready=0
+				done
+				[ $ready = 1 ] || continue
+
+				if stage_uptodate $name; then
+					echo -e "\e[1;32m [skip] ${name} is up to date \e[0m"
+					state[$name]="done"
+					launched=1
+					continue
+				fi
+				[ $free -gt 0 ] || continue
+
+				n=${STAGE_SLOTS[$name]}
+				[ $n -gt $total ] && n=$total
+				[ $n -gt $free ] && n=$free
+				[ $n -lt 1 ] && n=1
+				slots[$name]=$n
+				free=$((free - n))
+
+				echo -e "\e[1;33m [start] ${name} (${n} cores), log: ${BUILD}/logs/${name}.log \e[0m"
+				rm -f ${BUILD}/.stages/${name}
+				(
+					# 阶段中任一命令失败即结束子 shell，使该阶段失败
+					set -e
+					CORES=$n
+					${STAGE_FUNC[$name]}
+				) > ${BUILD}/logs/${name}.log 2>&1 < /dev/null &
+				pid[$name]=$!
+				state[$name]="running"
+				launched=1
+			done
+		done
+
+		running=0
+		pending=0
+		for name in "${STAGES[@]}"; do
+			[ "${state[$name]}" = "running" ] && running=$((running + 1))
+			[ "${state[$name]}" = "pending" ] && pending=$((pending + 1))
+		done
+		[ $running = 0 ] && break
+
+		# 等待任一阶段结束，回收其占用的核数
+		wait -n || true
+		for name in "${STAGES[@]}"; do
+			[ "${state[$name]}" = "running" ] || continue
+			kill -0 ${pid[$name]} 2>/dev/null && continue
+
+			rc=0
+			wait ${pid[$name]} || rc=$?
+			free=$((free + ${slots[$name]}))
+			if [ $rc != 0 ]; then
+				echo -e "\e[1;31m [fail] ${name}, last lines of ${BUILD}/logs/${name}.log: \e[0m"
+				tail -n 20 ${BUILD}/logs/${name}.log
+				for dep in "${STAGES[@]}"; do
+					[ "${state[$dep]}" = "running" ] && kill ${pid[$dep]} 2>/dev/null
+				done
+				wait
+				exit 1
+			fi
+			echo "${STAGE_SIG[$name]}" > ${BUILD}/.stages/${name}
+			echo -e "\e[1;32m [done] ${name} \e[0m"
+			state[$name]="done"
+		done
+	done
+
+	if [ $pending != 0 ]; then
+		echo -e "\e[1;31m Unresolved stage dependencies \e[0m"
+		exit 1
+	fi
+}
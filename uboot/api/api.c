@@ -13,6 +13,7 @@
 #include <environment.h>
 #include <linux/types.h>
 #include <api_public.h>
+#include <api_ext.h>
 
 #include "api_private.h"
 
@@ -43,6 +44,88 @@ typedef	int (*cfp_t)(va_list argp);
 
 static int calls_no;
 
+#ifndef CONFIG_API_CONSOLE_BUFFER
+#define CONFIG_API_CONSOLE_BUFFER	0
+#endif
+
+/* console output goes out through puts() in chunks of this size */
+#define CONS_CHUNK	256
+
+#define CONS_RING_SIZE	(CONFIG_API_CONSOLE_BUFFER ? CONFIG_API_CONSOLE_BUFFER : 1)
+
+/*
+ * Console output ring (CONFIG_API_CONSOLE_BUFFER bytes, 0 disables it).
+ * Output of API_putc, API_puts and API_cons_write is queued here and reaches
+ * the console when the consumer waits or polls anyway (API_udelay,
+ * API_get_timer, API_getc, API_tstc), flushes explicitly, or the ring is
+ * full, so verbose consumers don't pay for console I/O on every call.
+ */
+static char cons_ring[CONS_RING_SIZE];
+static int cons_head, cons_len;
+
+/*
+ * Send exactly n bytes to the console. puts() stops at a NUL, so runs of
+ * text go out through puts() in CONS_CHUNK pieces and NULs through putc().
+ */
+static void cons_put(const char *s, int n)
+{
+	char chunk[CONS_CHUNK + 1];
+	int len;
+
+	while (n > 0) {
+		len = strnlen(s, min(n, CONS_CHUNK));
+		if (len) {
+			memcpy(chunk, s, len);
+			chunk[len] = '\0';
+			puts(chunk);
+		} else {
+			putc('\0');
+			len = 1;
+		}
+
+		s += len;
+		n -= len;
+	}
+}
+
+static void cons_drain(void)
+{
+	int n;
+
+	while (cons_len > 0) {
+		n = min(cons_len, CONS_RING_SIZE - cons_head);
+		cons_put(cons_ring + cons_head, n);
+
+		cons_head = (cons_head + n) % CONS_RING_SIZE;
+		cons_len -= n;
+	}
+}
+
+static void cons_write(const char *s, int len)
+{
+	int n, tail;
+
+	if (CONFIG_API_CONSOLE_BUFFER == 0) {
+		/* unbuffered: one puts() per chunk instead of per char */
+		cons_put(s, len);
+		return;
+	}
+
+	while (len > 0) {
+		if (cons_len == CONS_RING_SIZE)
+			cons_drain();
+
+		tail = (cons_head + cons_len) % CONS_RING_SIZE;
+		n = min(len, CONS_RING_SIZE - cons_len);
+		n = min(n, CONS_RING_SIZE - tail);
+		memcpy(cons_ring + tail, s, n);
+		cons_len += n;
+
+		s += n;
+		len -= n;
+	}
+}
+
 /*
  * pseudo signature:
  *
@@ -55,6 +138,8 @@ static int API_getc(va_list ap)
 	if ((c = (int *)va_arg(ap, uintptr_t)) == NULL)
 		return API_EINVAL;
 
+	/* the prompt must be out before we wait for input */
+	cons_drain();
 	*c = getc();
 	return 0;
 }
@@ -71,6 +156,7 @@ static int API_tstc(va_list ap)
 	if ((t = (int *)va_arg(ap, uintptr_t)) == NULL)
 		return API_EINVAL;
 
+	cons_drain();
 	*t = tstc();
 	return 0;
 }
@@ -87,7 +173,10 @@ static int API_putc(va_list ap)
 	if ((c = (char *)va_arg(ap, uintptr_t)) == NULL)
 		return API_EINVAL;
 
-	putc(*c);
+	if (CONFIG_API_CONSOLE_BUFFER)
+		cons_write(c, 1);
+	else
+		putc(*c);
 	return 0;
 }
 
@@ -103,7 +192,48 @@ static int API_puts(va_list ap)
 	if ((s = (char *)va_arg(ap, uintptr_t)) == NULL)
 		return API_EINVAL;
 
-	puts(s);
+	if (CONFIG_API_CONSOLE_BUFFER)
+		cons_write(s, strlen(s));
+	else
+		puts(s);
+	return 0;
+}
+
+/*
+ * pseudo signature:
+ *
+ * int API_cons_write(const char *buf, int *len)
+ *
+ * buf: ptr to the text to print, doesn't need to be NUL terminated
+ *
+ * len: ptr to the number of bytes to print
+ */
+static int API_cons_write(va_list ap)
+{
+	char *buf;
+	int *len;
+
+	if ((buf = (char *)va_arg(ap, uintptr_t)) == NULL)
+		return API_EINVAL;
+	if ((len = (int *)va_arg(ap, uintptr_t)) == NULL)
+		return API_EINVAL;
+	if (*len < 0)
+		return API_EINVAL;
+
+	cons_write(buf, *len);
+	return 0;
+}
+
+/*
+ * pseudo signature:
+ *
+ * int API_cons_flush(void)
+ *
+ * Writes out console output still queued in the ring buffer
+ */
+static int API_cons_flush(va_list ap)
+{
+	cons_drain();
 	return 0;
 }
 
@@ -114,6 +244,7 @@ static int API_puts(va_list ap)
  */
 static int API_reset(va_list ap)
 {
+	cons_drain();
 	do_reset(NULL, 0, 0, NULL);
 
 	/* NOT REACHED */
@@ -151,6 +282,8 @@ static int API_udelay(va_list ap)
 	if ((d = (unsigned long *)va_arg(ap, unsigned long)) == NULL)
 		return API_EINVAL;
 
+	/* the consumer is waiting anyway, a good time to print */
+	cons_drain();
 	udelay(*d);
 	return 0;
 }
@@ -172,6 +305,8 @@ static int API_get_timer(va_list ap)
 	if (base == NULL)
 		return API_EINVAL;
 
+	/* timer polls usually mean the consumer is busy waiting */
+	cons_drain();
 	*cur = get_timer(*base);
 	return 0;
 }
@@ -187,10 +322,11 @@ static int API_get_timer(va_list ap)
  * cookies uniqely identify the previously enumerated device instance and
  * provide a hint for what to inspect in current enum iteration:
  *
- *   - net: &eth_device struct address from list pointed to by eth_devices
+ *   - net: &eth_device struct address from list pointed to by eth_devices,
+ *     or the current eth udevice with CONFIG_DM_ETH
  *
- *   - storage: struct blk_desc struct address from &ide_dev_desc[n],
- *     &scsi_dev_desc[n] and similar tables
+ *   - storage: address of the device's slot in the registry built by
+ *     dev_stor_init(), one slot per possible ide/scsi/mmc/... device
  *
  ****************************************************************************/
 
@@ -295,27 +431,38 @@ static int API_dev_close(va_list ap)
 
 
 /*
- * Notice: this is for sending network packets only, as U-Boot does not
- * support writing to storage at the moment (12.2007)
- *
  * pseudo signature:
  *
  * int API_dev_write(
  *	struct device_info *di,
  *	void *buf,
- *	int *len
+ *	int *len,
+ *	unsigned long *start,
+ *	size_t *act_len
  * )
  *
  * buf:	ptr to buffer from where to get the data to send
  *
- * len: length of packet to be sent (in bytes)
+ * len: ptr to length to be written
+ *      - network: len of packet to be sent (in bytes)
+ *      - storage: # of blocks to write (can vary in size depending on define)
+ *
+ * start: ptr to start block (only used for storage devices, not passed for
+ *        network)
+ *
+ * act_len: ptr to where to put the # of blocks actually written (only used
+ *          for storage devices, not passed for network)
  *
+ * Storage writes may be batched, use API_dev_flush to make sure they have
+ * reached the device.
  */
 static int API_dev_write(va_list ap)
 {
 	struct device_info *di;
 	void *buf;
 	int *len;
+	lbasize_t *len_stor, *act_len_stor;
+	lbastart_t *start;
 	int err = 0;
 
 	/* 1. arg is ptr to the device_info struct */
@@ -333,29 +480,69 @@ static int API_dev_write(va_list ap)
 	if (buf == NULL)
 		return API_EINVAL;
 
-	/* 3. arg is length of buffer */
-	len = (int *)va_arg(ap, uintptr_t);
-	if (len == NULL)
-		return API_EINVAL;
-	if (*len <= 0)
-		return API_EINVAL;
+	if (di->type & DEV_TYP_STOR) {
+		/* 3. arg - ptr to var with # of blocks to write */
+		len_stor = (lbasize_t *)va_arg(ap, uintptr_t);
+		if (!len_stor)
+			return API_EINVAL;
+		if (*len_stor <= 0)
+			return API_EINVAL;
 
-	if (di->type & DEV_TYP_STOR)
-		/*
-		 * write to storage is currently not supported by U-Boot:
-		 * no storage device implements block_write() method
-		 */
-		return API_ENODEV;
+		/* 4. arg - ptr to var with start block */
+		start = (lbastart_t *)va_arg(ap, uintptr_t);
+		if (!start)
+			return API_EINVAL;
+
+		/* 5. arg - ptr to var where to put the len actually written */
+		act_len_stor = (lbasize_t *)va_arg(ap, uintptr_t);
+		if (!act_len_stor)
+			return API_EINVAL;
+
+		*act_len_stor = dev_write_stor(di->cookie, buf, *len_stor, *start);
+
+	} else if (di->type & DEV_TYP_NET) {
+		/* 3. arg is length of buffer */
+		len = (int *)va_arg(ap, uintptr_t);
+		if (len == NULL)
+			return API_EINVAL;
+		if (*len <= 0)
+			return API_EINVAL;
 
-	else if (di->type & DEV_TYP_NET)
 		err = dev_write_net(di->cookie, buf, *len);
-	else
+	} else
 		err = API_ENODEV;
 
 	return err;
 }
 
 
+/*
+ * pseudo signature:
+ *
+ * int API_dev_flush(struct device_info *di)
+ *
+ * Writes out storage writes still batched by API_dev_write; closing the
+ * device flushes as well.
+ */
+static int API_dev_flush(va_list ap)
+{
+	struct device_info *di;
+
+	/* arg is ptr to the device_info struct */
+	di = (struct device_info *)va_arg(ap, uintptr_t);
+	if (di == NULL)
+		return API_EINVAL;
+
+	if (di->cookie == NULL)
+		return API_ENODEV;
+
+	if (!(di->type & DEV_TYP_STOR))
+		return 0;
+
+	return dev_flush_stor(di->cookie);
+}
+
+
 /*
  * pseudo signature:
  *
@@ -442,6 +629,203 @@ static int API_dev_read(va_list ap)
 }
 
 
+/*
+ * pseudo signature:
+ *
+ * int API_dev_readv(
+ *	struct device_info *di,
+ *	struct stor_iovec *iov,
+ *	int *iovcnt,
+ *	lbasize_t *act_len
+ * )
+ *
+ * Reads several block ranges of a storage device in one call, stopping at
+ * the first short read.
+ *
+ * iov: ptr to the array of segments (buffer, start block, # of blocks)
+ *
+ * iovcnt: ptr to the number of segments
+ *
+ * act_len: ptr to where to put the total # of blocks actually read
+ */
+static int API_dev_readv(va_list ap)
+{
+	struct device_info *di;
+	struct stor_iovec *iov;
+	lbasize_t *act_len, n;
+	int *iovcnt, i;
+
+	/* 1. arg is ptr to the device_info struct */
+	di = (struct device_info *)va_arg(ap, uintptr_t);
+	if (di == NULL)
+		return API_EINVAL;
+
+	if (di->cookie == NULL)
+		return API_ENODEV;
+
+	if (!(di->type & DEV_TYP_STOR))
+		return API_ENODEV;
+
+	/* 2. arg is ptr to the segments */
+	iov = (struct stor_iovec *)va_arg(ap, uintptr_t);
+	if (iov == NULL)
+		return API_EINVAL;
+
+	/* 3. arg is ptr to the number of segments */
+	iovcnt = (int *)va_arg(ap, uintptr_t);
+	if (iovcnt == NULL || *iovcnt <= 0)
+		return API_EINVAL;
+
+	/* 4. arg - ptr to var where to put the len actually read */
+	act_len = (lbasize_t *)va_arg(ap, uintptr_t);
+	if (act_len == NULL)
+		return API_EINVAL;
+
+	*act_len = 0;
+	for (i = 0; i < *iovcnt; i++) {
+		if (iov[i].buf == NULL)
+			return API_EINVAL;
+		if (iov[i].len <= 0)
+			continue;
+
+		n = dev_read_stor(di->cookie, iov[i].buf, iov[i].len,
+				  iov[i].start);
+		*act_len += n;
+		if (n != iov[i].len)
+			break;
+	}
+
+	return 0;
+}
+
+
+/*
+ * pseudo signature:
+ *
+ * int API_net_recv_batch(
+ *	struct device_info *di,
+ *	struct net_desc *ring,
+ *	int *cnt
+ * )
+ *
+ * Receives up to *cnt frames without blocking, one per descriptor.
+ *
+ * ring: ptr to the descriptors; len is the buffer size on entry and the
+ *       frame length on return
+ *
+ * cnt: ptr to the number of descriptors; on return the # of frames received
+ */
+static int API_net_recv_batch(va_list ap)
+{
+	struct device_info *di;
+	struct net_desc *ring;
+	int *cnt, rv;
+
+	/* 1. arg is ptr to the device_info struct */
+	di = (struct device_info *)va_arg(ap, uintptr_t);
+	if (di == NULL)
+		return API_EINVAL;
+
+	if (di->cookie == NULL || !(di->type & DEV_TYP_NET))
+		return API_ENODEV;
+
+	/* 2. arg is ptr to the descriptors */
+	ring = (struct net_desc *)va_arg(ap, uintptr_t);
+	if (ring == NULL)
+		return API_EINVAL;
+
+	/* 3. arg is ptr to the number of descriptors */
+	cnt = (int *)va_arg(ap, uintptr_t);
+	if (cnt == NULL || *cnt <= 0)
+		return API_EINVAL;
+
+	rv = dev_read_net_batch(di->cookie, ring, *cnt);
+	if (rv < 0)
+		return rv;
+
+	*cnt = rv;
+	return 0;
+}
+
+/*
+ * pseudo signature:
+ *
+ * int API_net_send_batch(
+ *	struct device_info *di,
+ *	struct net_desc *ring,
+ *	int *cnt
+ * )
+ *
+ * Sends *cnt frames, stopping at the first failure.
+ *
+ * cnt: ptr to the number of descriptors; on return the # of frames sent
+ */
+static int API_net_send_batch(va_list ap)
+{
+	struct device_info *di;
+	struct net_desc *ring;
+	int *cnt, rv;
+
+	/* 1. arg is ptr to the device_info struct */
+	di = (struct device_info *)va_arg(ap, uintptr_t);
+	if (di == NULL)
+		return API_EINVAL;
+
+	if (di->cookie == NULL || !(di->type & DEV_TYP_NET))
+		return API_ENODEV;
+
+	/* 2. arg is ptr to the descriptors */
+	ring = (struct net_desc *)va_arg(ap, uintptr_t);
+	if (ring == NULL)
+		return API_EINVAL;
+
+	/* 3. arg is ptr to the number of descriptors */
+	cnt = (int *)va_arg(ap, uintptr_t);
+	if (cnt == NULL || *cnt <= 0)
+		return API_EINVAL;
+
+	rv = dev_write_net_batch(di->cookie, ring, *cnt);
+	if (rv < 0)
+		return rv;
+
+	*cnt = rv;
+	return 0;
+}
+
+/*
+ * pseudo signature:
+ *
+ * int API_net_poll(struct device_info *di, int *ready)
+ *
+ * ready: ptr to where to put the # of received frames waiting to be read
+ */
+static int API_net_poll(va_list ap)
+{
+	struct device_info *di;
+	int *ready, rv;
+
+	/* 1. arg is ptr to the device_info struct */
+	di = (struct device_info *)va_arg(ap, uintptr_t);
+	if (di == NULL)
+		return API_EINVAL;
+
+	if (di->cookie == NULL || !(di->type & DEV_TYP_NET))
+		return API_ENODEV;
+
+	/* 2. arg is ptr to where to put the # of frames ready */
+	ready = (int *)va_arg(ap, uintptr_t);
+	if (ready == NULL)
+		return API_EINVAL;
+
+	rv = dev_poll_net(di->cookie);
+	if (rv < 0)
+		return rv;
+
+	*ready = rv;
+	return 0;
+}
+
+
 /*
  * pseudo signature:
  *
@@ -492,6 +876,8 @@ static int API_env_set(va_list ap)
  * int API_env_enum(const char *last, char **next)
  *
  * last: ptr to name of env var found in last iteration
+ *
+ * Prefer API_env_enum_next/API_env_export, which need no copying at all.
  */
 static int API_env_enum(va_list ap)
 {
@@ -499,6 +885,7 @@ static int API_env_enum(va_list ap)
 	char *last, **next, *s;
 	ENTRY *match, search;
 	static char *var;
+	static int var_size, var_idx;
 
 	last = (char *)va_arg(ap, unsigned long);
 
@@ -506,15 +893,19 @@ static int API_env_enum(va_list ap)
 		return API_EINVAL;
 
 	if (last == NULL) {
-		var = NULL;
 		i = 0;
+	} else if (last == var) {
+		/* the usual case: continue after what we returned last time */
+		i = var_idx;
 	} else {
-		var = strdup(last);
-		s = strchr(var, '=');
-		if (s != NULL)
-			*s = 0;
-		search.key = var;
+		s = strdup(last);
+		if (s == NULL) {
+			i = API_ENOMEM;
+			goto done;
+		}
+		search.key = strsep(&s, "=");
 		i = hsearch_r(search, FIND, &match, &env_htab, 0);
+		free(search.key);
 		if (i == 0) {
 			i = API_EINVAL;
 			goto done;
@@ -526,18 +917,111 @@ static int API_env_enum(va_list ap)
 	if (i == 0)
 		goto done;
 	buflen = strlen(match->key) + strlen(match->data) + 2;
-	var = realloc(var, buflen);
+	if (buflen > var_size) {
+		/* only grow the buffer, most variables fit in what we have */
+		free(var);
+		var = malloc(buflen);
+		if (var == NULL) {
+			i = API_ENOMEM;
+			goto done;
+		}
+		var_size = buflen;
+	}
 	snprintf(var, buflen, "%s=%s", match->key, match->data);
+	var_idx = i;
 	*next = var;
 	return 0;
 
 done:
 	free(var);
 	var = NULL;
+	var_size = 0;
 	*next = NULL;
 	return i;
 }
 
+/*
+ * pseudo signature:
+ *
+ * int API_env_enum_next(int *cursor, const char **name, const char **value)
+ *
+ * cursor: ptr to the iterator, 0 to start; set to 0 when there are no more
+ *         variables (name and value are then NULL)
+ *
+ * name, value: ptrs to where to put the name and value of the next env var;
+ *         they point into the environment itself and stay valid until it is
+ *         changed
+ */
+static int API_env_enum_next(va_list ap)
+{
+	int *cursor;
+	const char **name, **value;
+	ENTRY *match;
+
+	if ((cursor = (int *)va_arg(ap, uintptr_t)) == NULL)
+		return API_EINVAL;
+	if ((name = (const char **)va_arg(ap, uintptr_t)) == NULL)
+		return API_EINVAL;
+	if ((value = (const char **)va_arg(ap, uintptr_t)) == NULL)
+		return API_EINVAL;
+
+	/* the cursor is the hashtable index of the previous entry */
+	*cursor = hmatch_r("", *cursor, &match, &env_htab);
+	if (*cursor == 0) {
+		*name = NULL;
+		*value = NULL;
+		return 0;
+	}
+
+	*name = match->key;
+	*value = match->data;
+	return 0;
+}
+
+/*
+ * pseudo signature:
+ *
+ * int API_env_export(char *buf, size_t *len)
+ *
+ * Copies the whole environment to buf as "name=value\0" strings, followed by
+ * an empty string. Variables are not sorted.
+ *
+ * buf: ptr to the buffer to fill
+ *
+ * len: ptr to the size of buf; on return the number of bytes used, or the
+ *      number of bytes needed if buf was too small (API_ENOMEM)
+ */
+static int API_env_export(va_list ap)
+{
+	char *buf;
+	size_t *len, used = 0, n;
+	ENTRY *match;
+	int i = 0;
+
+	if ((buf = (char *)va_arg(ap, uintptr_t)) == NULL)
+		return API_EINVAL;
+	if ((len = (size_t *)va_arg(ap, uintptr_t)) == NULL)
+		return API_EINVAL;
+
+	while ((i = hmatch_r("", i, &match, &env_htab)) != 0) {
+		n = strlen(match->key) + strlen(match->data) + 2;
+		if (used + n < *len)
+			sprintf(buf + used, "%s=%s", match->key, match->data);
+		used += n;
+	}
+
+	/* terminating empty string */
+	used++;
+	if (used > *len) {
+		*len = used;
+		return API_ENOMEM;
+	}
+
+	buf[used - 1] = '\0';
+	*len = used;
+	return 0;
+}
+
 /*
  * pseudo signature:
  *
@@ -582,7 +1066,75 @@ static int API_display_clear(va_list ap)
 	return 0;
 }
 
-static cfp_t calls_table[API_MAXCALL] = { NULL, };
+/*
+ * pseudo signature:
+ *
+ * int API_display_get_fb(struct display_fb_info *fb)
+ */
+static int API_display_get_fb(va_list ap)
+{
+	struct display_fb_info *fb;
+
+	fb = (struct display_fb_info *)va_arg(ap, uintptr_t);
+
+	return display_get_fb(fb);
+}
+
+/*
+ * pseudo signature:
+ *
+ * int API_display_blit(struct display_rect *rect, const void *pixels,
+ *			int stride)
+ *
+ * pixels are in the framebuffer format (see API_display_get_fb), stride is
+ * the length of a source line in bytes
+ */
+static int API_display_blit(va_list ap)
+{
+	struct display_rect *rect;
+	const void *pixels;
+	int stride;
+
+	rect = (struct display_rect *)va_arg(ap, uintptr_t);
+	pixels = (const void *)va_arg(ap, uintptr_t);
+	stride = va_arg(ap, int);
+
+	return display_blit(rect, pixels, stride);
+}
+
+/*
+ * pseudo signature:
+ *
+ * int API_display_fill(struct display_rect *rect, u32 color)
+ */
+static int API_display_fill(va_list ap)
+{
+	struct display_rect *rect;
+	u32 color;
+
+	rect = (struct display_rect *)va_arg(ap, uintptr_t);
+	color = va_arg(ap, u32);
+
+	return display_fill(rect, color);
+}
+
+/*
+ * pseudo signature:
+ *
+ * int API_display_flush(struct display_rect *rect)
+ *
+ * rect: the area drawn since the last flush, NULL for the whole screen
+ */
+static int API_display_flush(va_list ap)
+{
+	struct display_rect *rect;
+
+	rect = (struct display_rect *)va_arg(ap, uintptr_t);
+
+	return display_flush(rect);
+}
+
+static cfp_t calls_table[API_EXT_MAXCALL] = { NULL, };
 
 /*
  * The main syscall entry point - this is not reentrant, only one call is
@@ -648,7 +1200,20 @@ void api_init(void)
 	calls_table[API_DISPLAY_GET_INFO] = &API_display_get_info;
 	calls_table[API_DISPLAY_DRAW_BITMAP] = &API_display_draw_bitmap;
 	calls_table[API_DISPLAY_CLEAR] = &API_display_clear;
-	calls_no = API_MAXCALL;
+	calls_table[API_DEV_READV] = &API_dev_readv;
+	calls_table[API_DEV_FLUSH] = &API_dev_flush;
+	calls_table[API_ENV_ENUM_NEXT] = &API_env_enum_next;
+	calls_table[API_ENV_EXPORT] = &API_env_export;
+	calls_table[API_CONS_WRITE] = &API_cons_write;
+	calls_table[API_CONS_FLUSH] = &API_cons_flush;
+	calls_table[API_NET_RECV_BATCH] = &API_net_recv_batch;
+	calls_table[API_NET_SEND_BATCH] = &API_net_send_batch;
+	calls_table[API_NET_POLL] = &API_net_poll;
+	calls_table[API_DISPLAY_GET_FB] = &API_display_get_fb;
+	calls_table[API_DISPLAY_BLIT] = &API_display_blit;
+	calls_table[API_DISPLAY_FILL] = &API_display_fill;
+	calls_table[API_DISPLAY_FLUSH] = &API_display_flush;
+	calls_no = API_EXT_MAXCALL;
 
 	debugf("API initialized with %d calls\n", calls_no);
 
@@ -4,8 +4,11 @@
  */
 
 #include <common.h>
+#include <dm.h>
 #include <api_public.h>
+#include <api_ext.h>
 #include <lcd.h>
+#include <video.h>
 #include <video_font.h> /* Get font width and height */
 
 /* lcd.h needs BMP_LOGO_HEIGHT to calculate CONSOLE_ROWS */
@@ -13,10 +16,47 @@
 #include <bmp_logo.h>
 #endif
 
-/* TODO(clchiou): add support of video device */
+#ifdef CONFIG_DM_VIDEO
+/* returns: the first video device and its uclass data, NULL if none */
+static struct video_priv *display_video(struct udevice **devp)
+{
+	if (uclass_first_device_err(UCLASS_VIDEO, devp))
+		return NULL;
+
+	return dev_get_uclass_priv(*devp);
+}
+
+/*
+ * Clips r to the screen
+ *
+ * returns:	0 if something is left to draw, API_EINVAL otherwise
+ */
+static int display_clip(struct video_priv *priv, struct display_rect *r)
+{
+	if (r->x < 0) {
+		r->w += r->x;
+		r->x = 0;
+	}
+	if (r->y < 0) {
+		r->h += r->y;
+		r->y = 0;
+	}
+	if (r->x + r->w > priv->xsize)
+		r->w = priv->xsize - r->x;
+	if (r->y + r->h > priv->ysize)
+		r->h = priv->ysize - r->y;
+
+	return (r->w > 0 && r->h > 0) ? 0 : API_EINVAL;
+}
+#endif
 
 int display_get_info(int type, struct display_info *di)
 {
+#ifdef CONFIG_DM_VIDEO
+	struct udevice *dev;
+	struct video_priv *priv;
+#endif
+
 	if (!di)
 		return API_EINVAL;
 
@@ -32,6 +72,17 @@ int display_get_info(int type, struct display_info *di)
 		di->screen_rows = lcd_get_screen_rows();
 		di->screen_cols = lcd_get_screen_columns();
 		break;
+#endif
+#ifdef CONFIG_DM_VIDEO
+	case DISPLAY_TYPE_VIDEO:
+		priv = display_video(&dev);
+		if (!priv)
+			return API_ENODEV;
+		di->pixel_width  = priv->xsize;
+		di->pixel_height = priv->ysize;
+		di->screen_rows = priv->ysize / VIDEO_FONT_HEIGHT;
+		di->screen_cols = priv->xsize / VIDEO_FONT_WIDTH;
+		break;
 #endif
 	}
 
@@ -54,5 +105,177 @@ void display_clear(void)
 {
 #ifdef CONFIG_LCD
 	lcd_clear();
+#elif defined(CONFIG_DM_VIDEO)
+	struct udevice *dev;
+
+	if (display_video(&dev))
+		video_clear(dev);
+#endif
+}
+
+/*
+ * Raw framebuffer access on the DM video device, for consumers redrawing
+ * at animation rates (boot splash, charge animation): pixels are in the
+ * framebuffer's own format, nothing is decoded or converted.
+ */
+
+int display_get_fb(struct display_fb_info *fb)
+{
+#ifdef CONFIG_DM_VIDEO
+	struct udevice *dev;
+	struct video_priv *priv;
+
+	if (!fb)
+		return API_EINVAL;
+
+	priv = display_video(&dev);
+	if (!priv)
+		return API_ENODEV;
+
+	fb->base = priv->fb;
+	fb->width = priv->xsize;
+	fb->height = priv->ysize;
+	fb->line_length = priv->line_length;
+	fb->bpp = 1 << priv->bpix;
+	return 0;
+#else
+	return API_ENODEV;
+#endif
+}
+
+/*
+ * Copies a w x h block of pixels to (x, y); src_stride is the length of a
+ * source line in bytes. Parts outside the screen are skipped.
+ */
+int display_blit(struct display_rect *rect, const void *src, int src_stride)
+{
+#ifdef CONFIG_DM_VIDEO
+	struct udevice *dev;
+	struct video_priv *priv;
+	struct display_rect r;
+	const uchar *s;
+	uchar *d;
+	int bytes, i;
+
+	if (!rect || !src)
+		return API_EINVAL;
+
+	priv = display_video(&dev);
+	if (!priv)
+		return API_ENODEV;
+
+	r = *rect;
+	if (display_clip(priv, &r))
+		return API_EINVAL;
+
+	bytes = VNBYTES(priv->bpix);
+	s = (const uchar *)src + (r.y - rect->y) * src_stride +
+	    (r.x - rect->x) * bytes;
+	d = (uchar *)priv->fb + r.y * priv->line_length + r.x * bytes;
+	for (i = 0; i < r.h; i++) {
+		memcpy(d, s, r.w * bytes);
+		s += src_stride;
+		d += priv->line_length;
+	}
+
+	return 0;
+#else
+	return API_ENODEV;
+#endif
+}
+
+/* fills a rectangle with one colour, given in the framebuffer's format */
+int display_fill(struct display_rect *rect, u32 color)
+{
+#ifdef CONFIG_DM_VIDEO
+	struct udevice *dev;
+	struct video_priv *priv;
+	struct display_rect r;
+	uchar *line;
+	int i, j;
+
+	if (!rect)
+		return API_EINVAL;
+
+	priv = display_video(&dev);
+	if (!priv)
+		return API_ENODEV;
+
+	r = *rect;
+	if (display_clip(priv, &r))
+		return API_EINVAL;
+
+	line = (uchar *)priv->fb + r.y * priv->line_length;
+	for (i = 0; i < r.h; i++, line += priv->line_length) {
+		switch (priv->bpix) {
+		case VIDEO_BPP8:
+			memset(line + r.x, color, r.w);
+			break;
+		case VIDEO_BPP16: {
+			u16 *p = (u16 *)line + r.x;
+
+			for (j = 0; j < r.w; j++)
+				*p++ = color;
+			break;
+		}
+		case VIDEO_BPP32: {
+			u32 *p = (u32 *)line + r.x;
+
+			for (j = 0; j < r.w; j++)
+				*p++ = color;
+			break;
+		}
+		default:
+			return API_ENODEV;
+		}
+	}
+
+	return 0;
+#else
+	return API_ENODEV;
+#endif
+}
+
+/*
+ * Makes a rectangle drawn through the framebuffer visible: flushes the
+ * data cache for its lines only, instead of the whole framebuffer as
+ * video_sync() does. NULL means the whole screen.
+ */
+int display_flush(struct display_rect *rect)
+{
+#ifdef CONFIG_DM_VIDEO
+	struct udevice *dev;
+	struct video_priv *priv;
+	struct display_rect r;
+
+	priv = display_video(&dev);
+	if (!priv)
+		return API_ENODEV;
+
+	if (!rect) {
+		video_sync(dev);
+		return 0;
+	}
+
+	r = *rect;
+	if (display_clip(priv, &r))
+		return 0;
+
+#ifndef CONFIG_SYS_DCACHE_OFF
+	if (priv->flush_dcache) {
+		ulong start = (ulong)priv->fb + r.y * priv->line_length;
+		ulong end = start + r.h * priv->line_length;
+
+		flush_dcache_range(start & ~(ARCH_DMA_MINALIGN - 1),
+				   ALIGN(end, ARCH_DMA_MINALIGN));
+	}
+#endif
+#ifdef CONFIG_SANDBOX
+	/* the SDL window is only refreshed by a sync */
+	video_sync(dev);
+#endif
+	return 0;
+#else
+	return API_ENODEV;
 #endif
 }
@@ -8,9 +8,11 @@
 
 #include <config.h>
 #include <common.h>
+#include <dm.h>
 #include <net.h>
 #include <linux/types.h>
 #include <api_public.h>
+#include <api_ext.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -25,13 +27,93 @@ DECLARE_GLOBAL_DATA_PTR;
 
 #define errf(fmt, args...) do { printf("ERROR @ %s(): ", __func__); printf(fmt, ##args); } while (0)
 
-#if defined(CONFIG_CMD_NET) && !defined(CONFIG_DM_ETH)
+#if defined(CONFIG_CMD_NET)
+
+/*
+ * Frames picked up by dev_poll_net() and not yet handed to the consumer.
+ * The driver can't tell whether a frame is waiting without taking it, so
+ * polling receives into this small FIFO and the next read drains it before
+ * asking the driver again.
+ */
+#define NET_STAGE_FRAMES	8
+
+static uchar net_stage[NET_STAGE_FRAMES][PKTSIZE_ALIGN];
+static int net_stage_len[NET_STAGE_FRAMES];
+static int net_stage_head, net_stage_cnt;
+
+#ifdef CONFIG_DM_ETH
+
+/*
+ * With driver model the cookie is the current eth udevice. Frames are
+ * taken from the driver one at a time through its recv/free_pkt ops, as
+ * eth_rx() would hand them to the network stack instead.
+ */
+static int dev_valid_net(void *cookie)
+{
+	struct udevice *dev = eth_get_dev();
+
+	return (dev != NULL && (void *)dev == cookie) ? 1 : 0;
+}
+
+static const uchar *net_hwaddr(void *cookie)
+{
+	struct eth_pdata *pdata = dev_get_platdata((struct udevice *)cookie);
+
+	return pdata->enetaddr;
+}
+
+static int net_receive(void *cookie, void *buf, int len)
+{
+	struct udevice *dev = cookie;
+	const struct eth_ops *ops = eth_get_ops(dev);
+	uchar *packet;
+	int ret;
+
+	if (!eth_is_active(dev))
+		return 0;
+
+	ret = ops->recv(dev, ETH_RECV_CHECK_DEVICE, &packet);
+	if (ret <= 0)
+		return 0;
+
+	len = min(ret, len);
+	memcpy(buf, packet, len);
+	if (ops->free_pkt)
+		ops->free_pkt(dev, packet, ret);
+
+	return len;
+}
+
+#else
 
 static int dev_valid_net(void *cookie)
 {
 	return ((void *)eth_get_dev() == cookie) ? 1 : 0;
 }
 
+static const uchar *net_hwaddr(void *cookie)
+{
+	return ((struct eth_device *)cookie)->enetaddr;
+}
+
+static int net_receive(void *cookie, void *buf, int len)
+{
+	return eth_receive(buf, len);
+}
+
+#endif
+
+/* hands the oldest staged frame to the consumer, truncated to len */
+static int net_stage_pop(void *buf, int len)
+{
+	len = min(net_stage_len[net_stage_head], len);
+	memcpy(buf, net_stage[net_stage_head], len);
+	net_stage_head = (net_stage_head + 1) % NET_STAGE_FRAMES;
+	net_stage_cnt--;
+
+	return len;
+}
+
 int dev_open_net(void *cookie)
 {
 	if (!dev_valid_net(cookie))
@@ -40,6 +122,7 @@ int dev_open_net(void *cookie)
 	if (eth_init() < 0)
 		return API_EIO;
 
+	net_stage_cnt = 0;
 	return 0;
 }
 
@@ -49,6 +132,7 @@ int dev_close_net(void *cookie)
 		return API_ENODEV;
 
 	eth_halt();
+	net_stage_cnt = 0;
 	return 0;
 }
 
@@ -58,14 +142,12 @@ int dev_close_net(void *cookie)
  */
 int dev_enum_net(struct device_info *di)
 {
-	struct eth_device *eth_current = eth_get_dev();
-
 	di->type = DEV_TYP_NET;
-	di->cookie = (void *)eth_current;
+	di->cookie = (void *)eth_get_dev();
 	if (di->cookie == NULL)
 		return 0;
 
-	memcpy(di->di_net.hwaddr, eth_current->enetaddr, 6);
+	memcpy(di->di_net.hwaddr, net_hwaddr(di->cookie), 6);
 
 	debugf("device found, returning cookie 0x%08x\n",
 		(u_int32_t)di->cookie);
@@ -82,9 +164,89 @@ int dev_write_net(void *cookie, void *buf, int len)
 
 int dev_read_net(void *cookie, void *buf, int len)
 {
-	/* XXX verify that cookie points to a valid net device??? */
+	/* the length is returned to the consumer as is: a stale cookie reads nothing */
+	if (!dev_valid_net(cookie))
+		return 0;
 
-	return eth_receive(buf, len);
+	/* frames staged by dev_poll_net() come first */
+	if (net_stage_cnt)
+		return net_stage_pop(buf, len);
+
+	return net_receive(cookie, buf, len);
+}
+
+/*
+ * Sends up to cnt frames described by desc[]
+ *
+ * returns:	# of frames sent, or the error of the first frame
+ */
+int dev_write_net_batch(void *cookie, struct net_desc *desc, int cnt)
+{
+	int i, err;
+
+	if (!dev_valid_net(cookie))
+		return API_ENODEV;
+
+	for (i = 0; i < cnt; i++) {
+		err = eth_send(desc[i].buf, desc[i].len);
+		if (err < 0)
+			return i ? i : err;
+	}
+
+	return i;
+}
+
+/*
+ * Receives up to cnt frames into desc[] without blocking, stopping at the
+ * first empty poll of the driver
+ *
+ * returns:	# of frames received; desc[i].len is updated to the length
+ *		of each frame (truncated to the buffer size)
+ */
+int dev_read_net_batch(void *cookie, struct net_desc *desc, int cnt)
+{
+	int i, len;
+
+	if (!dev_valid_net(cookie))
+		return API_ENODEV;
+
+	for (i = 0; i < cnt; i++) {
+		if (net_stage_cnt) {
+			len = net_stage_pop(desc[i].buf, desc[i].len);
+		} else {
+			len = net_receive(cookie, desc[i].buf, desc[i].len);
+			if (len <= 0)
+				break;
+		}
+		desc[i].len = len;
+	}
+
+	return i;
+}
+
+/*
+ * Checks for received frames without blocking
+ *
+ * returns:	# of frames ready for dev_read_net()/dev_read_net_batch()
+ *		(at most NET_STAGE_FRAMES)
+ */
+int dev_poll_net(void *cookie)
+{
+	int slot, len;
+
+	if (!dev_valid_net(cookie))
+		return API_ENODEV;
+
+	while (net_stage_cnt < NET_STAGE_FRAMES) {
+		slot = (net_stage_head + net_stage_cnt) % NET_STAGE_FRAMES;
+		len = net_receive(cookie, net_stage[slot], PKTSIZE_ALIGN);
+		if (len <= 0)
+			break;
+		net_stage_len[slot] = len;
+		net_stage_cnt++;
+	}
+
+	return net_stage_cnt;
 }
 
 #else
@@ -114,4 +276,19 @@ int dev_read_net(void *cookie, void *buf, int len)
 	return API_ENODEV;
 }
 
+int dev_write_net_batch(void *cookie, struct net_desc *desc, int cnt)
+{
+	return API_ENODEV;
+}
+
+int dev_read_net_batch(void *cookie, struct net_desc *desc, int cnt)
+{
+	return API_ENODEV;
+}
+
+int dev_poll_net(void *cookie)
+{
+	return API_ENODEV;
+}
+
 #endif
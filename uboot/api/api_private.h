@@ -23,13 +23,22 @@ int	dev_close_stor(void *);
 int	dev_close_net(void *);
 
 lbasize_t	dev_read_stor(void *, void *, lbasize_t, lbastart_t);
+lbasize_t	dev_write_stor(void *, void *, lbasize_t, lbastart_t);
+int		dev_flush_stor(void *);
 int		dev_read_net(void *, void *, int);
 int		dev_write_net(void *, void *, int);
+int		dev_read_net_batch(void *, struct net_desc *, int);
+int		dev_write_net_batch(void *, struct net_desc *, int);
+int		dev_poll_net(void *);
 
 void dev_stor_init(void);
 
 int display_get_info(int type, struct display_info *di);
 int display_draw_bitmap(ulong bitmap, int x, int y);
 void display_clear(void);
+int display_get_fb(struct display_fb_info *fb);
+int display_blit(struct display_rect *rect, const void *src, int src_stride);
+int display_fill(struct display_rect *rect, u32 color);
+int display_flush(struct display_rect *rect);
 
 #endif /* _API_PRIVATE_H_ */
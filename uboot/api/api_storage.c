@@ -8,7 +8,11 @@
 
 #include <config.h>
 #include <common.h>
+#include <malloc.h>
 #include <api_public.h>
+#include <api_ext.h>
+
+#include "api_private.h"
 
 #if defined(CONFIG_CMD_USB) && defined(CONFIG_USB_STORAGE)
 #include <usb.h>
@@ -33,22 +37,55 @@
 #define ENUM_SATA	4
 #define ENUM_MAX	5
 
+/*
+ * Device registry, built once in dev_stor_init(): one slot for every
+ * possible (type, device number) pair. The cookie handed out to API
+ * consumers is the address of the slot, so mapping a cookie back to its
+ * device, and continuing an enumeration, need no search over the block
+ * devices. A slot also keeps the state of a device opened through the API:
+ * the blk_desc validated at open time and the read-ahead / write batch
+ * buffer.
+ */
+struct stor_dev {
+	struct blk_desc	*dd;		/* refreshed on enumeration restart */
+	int		type;		/* ENUM_IDE, ENUM_USB etc. */
+	int		index;		/* device number within the type */
+	int		open;		/* dd validated by dev_open_stor() */
+	lbastart_t	next;		/* block following the previous read */
+	void		*buf;		/* read-ahead or write batch buffer */
+	lbasize_t	buf_max;	/* capacity of buf in blocks */
+	lbastart_t	ra_start;	/* first block read ahead into buf */
+	lbasize_t	ra_cnt;		/* # of blocks read ahead into buf */
+	lbastart_t	wb_start;	/* first block of the pending write batch */
+	lbasize_t	wb_cnt;		/* # of blocks waiting in buf */
+};
+
 struct stor_spec {
 	int		max_dev;
 	int		enum_started;
 	int		enum_ended;
 	int		type;	/* "external" type: DT_STOR_{IDE,USB,etc} */
 	char		*name;
+	struct stor_dev	*devs;	/* max_dev slots in the registry */
 };
 
 static struct stor_spec specs[ENUM_MAX] = { { 0, 0, 0, 0, NULL }, };
 
+static struct stor_dev *stor_devs;
+static int stor_devs_no;
+
 #ifndef CONFIG_SYS_MMC_MAX_DEVICE
 #define CONFIG_SYS_MMC_MAX_DEVICE	1
 #endif
 
+#ifndef CONFIG_API_STOR_READAHEAD
+#define CONFIG_API_STOR_READAHEAD	0
+#endif
+
 void dev_stor_init(void)
 {
+	int i, j, n;
+
 #if defined(CONFIG_IDE)
 	specs[ENUM_IDE].max_dev = CONFIG_SYS_IDE_MAXDEVICE;
 	specs[ENUM_IDE].enum_started = 0;
@@ -84,8 +121,47 @@ void dev_stor_init(void)
 	specs[ENUM_USB].type = DEV_TYP_STOR | DT_STOR_USB;
 	specs[ENUM_USB].name = "usb";
 #endif
+
+	for (i = ENUM_IDE; i < ENUM_MAX; i++)
+		stor_devs_no += specs[i].max_dev;
+
+	stor_devs = calloc(stor_devs_no, sizeof(struct stor_dev));
+	if (stor_devs == NULL) {
+		printf("API: could not allocate the storage device registry!\n");
+		stor_devs_no = 0;
+		for (i = ENUM_IDE; i < ENUM_MAX; i++)
+			specs[i].name = NULL;
+		return;
+	}
+
+	for (i = ENUM_IDE, n = 0; i < ENUM_MAX; i++) {
+		specs[i].devs = &stor_devs[n];
+		for (j = 0; j < specs[i].max_dev; j++, n++) {
+			stor_devs[n].type = i;
+			stor_devs[n].index = j;
+		}
+	}
+
+	dev_enum_reset();
+}
+
+/* returns: the registry slot a cookie points to, NULL if it is not ours */
+
+static struct stor_dev *stor_dev_of(void *cookie)
+{
+	uintptr_t off = (uintptr_t)cookie - (uintptr_t)stor_devs;
+
+	if (cookie == NULL || stor_devs == NULL)
+		return NULL;
+
+	if (off >= stor_devs_no * sizeof(struct stor_dev) ||
+	    off % sizeof(struct stor_dev))
+		return NULL;
+
+	return (struct stor_dev *)cookie;
 }
 
+
 /*
  * Finds next available device in the storage group
  *
@@ -98,6 +174,7 @@ void dev_stor_init(void)
  */
 static int dev_stor_get(int type, int *more, struct device_info *di)
 {
+	struct stor_dev *sd;
 	struct blk_desc *dd;
 	int found = 0;
 	int i = 0;
@@ -106,21 +183,15 @@ static int dev_stor_get(int type, int *more, struct device_info *di)
 	if (specs[type].name == NULL)
 		return 0;
 
-	if (di->cookie != NULL) {
-		/* Find the last device we've returned  */
-		for (i = 0; i < specs[type].max_dev; i++) {
-			if (di->cookie ==
-			    (void *)blk_get_dev(specs[type].name, i)) {
-				i += 1;
-				break;
-			}
-		}
-	}
+	/* Continue after the last device we've returned */
+	sd = stor_dev_of(di->cookie);
+	if (sd != NULL && sd->type == type)
+		i = sd->index + 1;
 
 	for (; i < specs[type].max_dev; i++) {
-		di->cookie = (void *)blk_get_dev(specs[type].name, i);
+		sd = &specs[type].devs[i];
 
-		if (di->cookie != NULL) {
+		if (sd->dd != NULL) {
 			found = 1;
 			break;
 		}
@@ -132,9 +203,10 @@ static int dev_stor_get(int type, int *more, struct device_info *di)
 		*more = 1;
 
 	if (found) {
+		di->cookie = (void *)sd;
 		di->type = specs[type].type;
 
-		dd = (struct blk_desc *)di->cookie;
+		dd = sd->dd;
 		if (dd->type == DEV_TYPE_UNKNOWN) {
 			debugf("device instance exists, but is not active..");
 			found = 0;
@@ -150,18 +222,13 @@ static int dev_stor_get(int type, int *more, struct device_info *di)
 }
 
 
-/* returns: ENUM_IDE, ENUM_USB etc. based on struct blk_desc */
+/* returns: ENUM_IDE, ENUM_USB etc. based on the cookie */
 
-static int dev_stor_type(struct blk_desc *dd)
+static int dev_stor_type(void *cookie)
 {
-	int i, j;
-
-	for (i = ENUM_IDE; i < ENUM_MAX; i++)
-		for (j = 0; j < specs[i].max_dev; j++)
-			if (dd == blk_get_dev(specs[i].name, j))
-				return i;
+	struct stor_dev *sd = stor_dev_of(cookie);
 
-	return ENUM_MAX;
+	return (sd != NULL) ? sd->type : ENUM_MAX;
 }
 
 
@@ -263,14 +330,25 @@ static int dev_enum_stor(int type, struct device_info *di)
 	return found;
 }
 
+
+/*
+ * Restarts the enumeration and looks up the devices present now (e.g. USB
+ * storage found after the API was initialized); devices opened through the
+ * API keep the blk_desc they were validated with
+ */
 void dev_enum_reset(void)
 {
+	struct stor_dev *sd;
 	int i;
 
 	for (i = 0; i < ENUM_MAX; i ++) {
 		specs[i].enum_started = 0;
 		specs[i].enum_ended = 0;
 	}
+
+	for (sd = stor_devs; sd < stor_devs + stor_devs_no; sd++)
+		if (!sd->open)
+			sd->dd = blk_get_dev(specs[sd->type].name, sd->index);
 }
 
 int dev_enum_storage(struct device_info *di)
@@ -286,62 +364,266 @@ int dev_enum_storage(struct device_info *di)
 	return 0;
 }
 
-static int dev_stor_is_valid(int type, struct blk_desc *dd)
+
+/* returns: 0/1 whether the slot still holds an active device */
+
+static int dev_stor_is_valid(struct stor_dev *sd)
 {
-	int i;
+	struct blk_desc *dd = blk_get_dev(specs[sd->type].name, sd->index);
 
-	for (i = 0; i < specs[type].max_dev; i++)
-		if (dd == blk_get_dev(specs[type].name, i))
-			if (dd->type != DEV_TYPE_UNKNOWN)
-				return 1;
+	if (dd == NULL || dd != sd->dd)
+		return 0;
 
-	return 0;
+	return (dd->type != DEV_TYPE_UNKNOWN) ? 1 : 0;
 }
 
 
 int dev_open_stor(void *cookie)
 {
-	int type = dev_stor_type(cookie);
+	struct stor_dev *sd = stor_dev_of(cookie);
 
-	if (type == ENUM_MAX)
+	if (sd == NULL)
 		return API_ENODEV;
 
-	if (dev_stor_is_valid(type, (struct blk_desc *)cookie))
+	if (sd->open)
 		return 0;
 
-	return API_ENODEV;
+	if (!dev_stor_is_valid(sd))
+		return API_ENODEV;
+
+	sd->open = 1;
+	sd->next = 0;
+	sd->ra_cnt = 0;
+	sd->wb_cnt = 0;
+	sd->buf_max = CONFIG_API_STOR_READAHEAD * 1024 / sd->dd->blksz;
+	sd->buf = NULL;
+	if (sd->buf_max > 0) {
+		sd->buf = memalign(ARCH_DMA_MINALIGN,
+				   sd->buf_max * sd->dd->blksz);
+		if (sd->buf == NULL)
+			sd->buf_max = 0;
+	}
+
+	return 0;
 }
 
 
+static int stor_flush(struct stor_dev *sd);
+
 int dev_close_stor(void *cookie)
 {
+	struct stor_dev *sd = stor_dev_of(cookie);
+	int err;
+
+	if (sd == NULL || !sd->open)
+		return 0;
+
 	/*
-	 * Not much to do as we actually do not alter storage devices upon
-	 * close
+	 * Write out what is still batched and drop the buffer; the device
+	 * itself is not altered upon close
 	 */
+	err = stor_flush(sd);
+	free(sd->buf);
+	sd->buf = NULL;
+	sd->buf_max = 0;
+	sd->open = 0;
+
+	return err;
+}
+
+
+static lbasize_t stor_bread(struct blk_desc *dd, lbastart_t start,
+			    lbasize_t len, void *buf)
+{
+#ifdef CONFIG_BLK
+	return blk_dread(dd, start, len, buf);
+#else
+	if ((dd->block_read) == NULL) {
+		debugf("no block_read() for device 0x%08x\n", dd);
+		return 0;
+	}
+
+	return dd->block_read(dd, start, len, buf);
+#endif	/* defined(CONFIG_BLK) */
+}
+
+
+static lbasize_t stor_bwrite(struct blk_desc *dd, lbastart_t start,
+			     lbasize_t len, void *buf)
+{
+#ifdef CONFIG_BLK
+	return blk_dwrite(dd, start, len, buf);
+#else
+	if ((dd->block_write) == NULL) {
+		debugf("no block_write() for device 0x%08x\n", dd);
+		return 0;
+	}
+
+	return dd->block_write(dd, start, len, buf);
+#endif	/* defined(CONFIG_BLK) */
+}
+
+
+/* writes out the pending write batch, returns: 0 or API_EIO */
+
+static int stor_flush(struct stor_dev *sd)
+{
+	lbasize_t cnt = sd->wb_cnt;
+
+	if (cnt == 0)
+		return 0;
+
+	sd->wb_cnt = 0;
+	if (stor_bwrite(sd->dd, sd->wb_start, cnt, sd->buf) != cnt) {
+		errf("writing %lu blocks at %lu failed\n", (ulong)cnt,
+		     (ulong)sd->wb_start);
+		return API_EIO;
+	}
+
 	return 0;
 }
 
 
+/*
+ * Reads through the read-ahead buffer of an opened device.
+ *
+ * Small reads that continue where the previous one ended refill the buffer
+ * with buf_max blocks, so loaders reading a file in small chunks hit the
+ * device once per buffer instead of once per call. Large or random reads go
+ * to the device directly.
+ */
+static lbasize_t stor_read_ahead(struct stor_dev *sd, void *buf,
+				 lbasize_t len, lbastart_t start)
+{
+	struct blk_desc *dd = sd->dd;
+	lbasize_t done = 0, n;
+
+	while (done < len) {
+		if (sd->ra_cnt && start >= sd->ra_start &&
+		    start < sd->ra_start + sd->ra_cnt) {
+			/* (partial) hit */
+			n = min_t(lbasize_t, len - done,
+				  sd->ra_start + sd->ra_cnt - start);
+			memcpy(buf, sd->buf + (start - sd->ra_start) * dd->blksz,
+			       n * dd->blksz);
+		} else if (len - done >= sd->buf_max || start != sd->next ||
+			   start >= dd->lba) {
+			n = stor_bread(dd, start, len - done, buf);
+			done += n;
+			start += n;
+			break;
+		} else {
+			sd->ra_start = start;
+			sd->ra_cnt = stor_bread(dd, start,
+					       min_t(lbasize_t, sd->buf_max,
+						     dd->lba - start),
+					       sd->buf);
+			if (sd->ra_cnt == 0)
+				break;
+			continue;
+		}
+
+		done += n;
+		start += n;
+		buf += n * dd->blksz;
+		sd->next = start;
+	}
+
+	sd->next = start;
+	return done;
+}
+
+
 lbasize_t dev_read_stor(void *cookie, void *buf, lbasize_t len, lbastart_t start)
 {
-	int type;
-	struct blk_desc *dd = (struct blk_desc *)cookie;
+	struct stor_dev *sd = stor_dev_of(cookie);
 
-	if ((type = dev_stor_type(dd)) == ENUM_MAX)
+	if (sd == NULL)
 		return 0;
 
-	if (!dev_stor_is_valid(type, dd))
+	if (sd->open) {
+		/* the buffer may hold batched writes, which reads must see */
+		if (stor_flush(sd))
+			return 0;
+		return stor_read_ahead(sd, buf, len, start);
+	}
+
+	/* not opened through the API, validate the cookie every time */
+	if (!dev_stor_is_valid(sd))
 		return 0;
 
-#ifdef CONFIG_BLK
-	return blk_dread(dd, start, len, buf);
-#else
-	if ((dd->block_read) == NULL) {
-		debugf("no block_read() for device 0x%08x\n", cookie);
+	return stor_bread(sd->dd, start, len, buf);
+}
+
+
+/*
+ * Writes to an opened device are batched: consecutive small writes are
+ * collected in the (DMA aligned) device buffer and written out as one large
+ * request when the buffer fills up, a non-consecutive write or a read comes
+ * in, or on dev_flush_stor()/dev_close_stor(). Writes of a full buffer or
+ * more go to the device directly.
+ *
+ * returns:	# of blocks written or accepted into the batch; errors of
+ *		batched blocks are reported by the flush
+ */
+lbasize_t dev_write_stor(void *cookie, void *buf, lbasize_t len, lbastart_t start)
+{
+	struct stor_dev *sd = stor_dev_of(cookie);
+	struct blk_desc *dd;
+	lbasize_t done = 0, n;
+
+	if (sd == NULL)
 		return 0;
+
+	if (!sd->open) {
+		/* not opened through the API, validate and write directly */
+		if (!dev_stor_is_valid(sd))
+			return 0;
+
+		return stor_bwrite(sd->dd, start, len, buf);
 	}
 
-	return dd->block_read(dd, start, len, buf);
-#endif	/* defined(CONFIG_BLK) */
+	dd = sd->dd;
+
+	/* the buffer is about to hold write data */
+	sd->ra_cnt = 0;
+
+	if (sd->wb_cnt && start != sd->wb_start + sd->wb_cnt)
+		if (stor_flush(sd))
+			return 0;
+
+	if (len >= sd->buf_max) {
+		if (stor_flush(sd))
+			return 0;
+		return stor_bwrite(dd, start, len, buf);
+	}
+
+	while (done < len) {
+		if (sd->wb_cnt == 0)
+			sd->wb_start = start;
+
+		n = min_t(lbasize_t, len - done, sd->buf_max - sd->wb_cnt);
+		memcpy(sd->buf + sd->wb_cnt * dd->blksz, buf, n * dd->blksz);
+		sd->wb_cnt += n;
+
+		if (sd->wb_cnt == sd->buf_max && stor_flush(sd))
+			return done;
+
+		done += n;
+		start += n;
+		buf += n * dd->blksz;
+	}
+
+	return done;
+}
+
+
+int dev_flush_stor(void *cookie)
+{
+	struct stor_dev *sd = stor_dev_of(cookie);
+
+	if (sd == NULL || !sd->open)
+		return 0;
+
+	return stor_flush(sd);
 }
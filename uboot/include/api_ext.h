@@ -0,0 +1,74 @@
+/*
+ * Extensions to the U-Boot API
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef _API_EXT_H_
+#define _API_EXT_H_
+
+#include <api_public.h>
+
+/*
+ * Additional syscalls. They are numbered after the calls in api_public.h,
+ * so existing API consumers keep working unchanged.
+ */
+enum {
+	API_DEV_READV = API_MAXCALL,
+	API_DEV_FLUSH,
+	API_ENV_ENUM_NEXT,
+	API_ENV_EXPORT,
+	API_CONS_WRITE,
+	API_CONS_FLUSH,
+	API_NET_RECV_BATCH,
+	API_NET_SEND_BATCH,
+	API_NET_POLL,
+	API_DISPLAY_GET_FB,
+	API_DISPLAY_BLIT,
+	API_DISPLAY_FILL,
+	API_DISPLAY_FLUSH,
+	API_EXT_MAXCALL
+};
+
+/*
+ * One segment of a vectored storage read (API_DEV_READV)
+ */
+struct stor_iovec {
+	void		*buf;
+	lbastart_t	start;		/* start block */
+	lbasize_t	len;		/* # of blocks */
+};
+
+/*
+ * One frame of a batched network receive/send (API_NET_RECV_BATCH,
+ * API_NET_SEND_BATCH)
+ */
+struct net_desc {
+	void		*buf;
+	int		len;		/* rx: buffer size in, frame length out;
+					   tx: frame length */
+};
+
+/*
+ * Framebuffer geometry of the video device (API_DISPLAY_GET_FB); pixels
+ * passed to the blit and fill calls are in this format
+ */
+struct display_fb_info {
+	void		*base;
+	int		width;		/* in pixels */
+	int		height;
+	int		line_length;	/* bytes per line */
+	int		bpp;		/* bits per pixel */
+};
+
+/*
+ * Screen rectangle, in pixels
+ */
+struct display_rect {
+	int		x;
+	int		y;
+	int		w;
+	int		h;
+};
+
+#endif /* _API_EXT_H_ */
@@ -112,7 +112,7 @@ help()
 	echo "	./make.sh [board|subcmd] [O=<dir>]"
 	echo
 	echo "	 - board: board name of defconfig"         # 板子名称（对应 configs/ 目录下的 defconfig 文件）
-	echo "	 - subcmd: loader|loader-all|trust|trust-all|uboot|elf|map|sym|<addr>|"  # 子命令选项
+	echo "	 - subcmd: loader|loader-all|trust|trust-all|uboot|rkpack|elf|map|sym|<addr>|"  # 子命令选项
 	echo "	 - O=<dir>: assigned output directory"     # 指定输出目录
 	echo
 	echo "Example:"
@@ -131,6 +131,7 @@ help()
 	echo "	./make.sh trust-all                --- pack trust img (all supported)"  # 打包所有支持的 trust 镜像
 	echo "	./make.sh loader                   --- pack loader bin"             # 打包 loader 二进制
 	echo "	./make.sh loader-all	           --- pack loader bin (all supported)"  # 打包所有支持的 loader
+	echo "	./make.sh rkpack [manifest]        --- pack uboot, loader and trust in parallel"  # 按清单并行打包三个镜像
 	echo
 	echo "3. Debug helper:"                             # 调试辅助命令示例
 	echo "	./make.sh elf                      --- dump elf file with -D(default)"  # 反汇编 ELF 文件（默认 -D 选项）
@@ -245,7 +246,7 @@ prepare()
 		# 如果没有指定O参数，则根据BOARD的值来决定输出目录
 		case $BOARD in
 			# 对于子命令或空命令，需要从现有的.config文件中解析输出目录
-			''|elf*|loader*|spl*|itb|debug*|trust|uboot|map|sym)
+			''|elf*|loader*|spl*|itb|debug*|trust|uboot|rkpack|map|sym)
 			# 查找当前目录及子目录下的.config文件数量
 			count=`find -name .config | wc -l`
 			# 获取.config文件的路径
@@ -292,7 +293,7 @@ prepare()
 		;;
 
 		# 对于子命令，不需要执行defconfig，直接跳过
-		''|elf*|loader*|spl*|itb|debug*|trust*|uboot|map|sym)
+		''|elf*|loader*|spl*|itb|debug*|trust*|uboot|rkpack|map|sym)
 		;;
 
 		# 对于其他情况，处理board配置或函数地址查询
@@ -473,6 +474,12 @@ sub_commands()
 		exit 0
 		;;
 
+		# 按清单并行打包 uboot、loader、trust 镜像（FILE 为清单路径，可省略）
+		rkpack)
+		rkpack_images ${FILE}
+		exit 0
+		;;
+
 		# 默认情况：地址查询功能（查找函数符号和代码位置）
 		*)
 		# 搜索函数地址对应的符号和代码位置
@@ -785,7 +792,10 @@ pack_uboot_image()
 	fi
 
 	# 使用 loaderimage 工具打包：添加 Rockchip 头部（magic、chip ID、load addr、size、CRC）
-	${RKTOOLS}/loaderimage --pack --uboot ${OUTDIR}/u-boot.bin uboot.img ${UBOOT_LOAD_ADDR} ${PLATFORM_UBOOT_IMG_SIZE}
+	if ! ${RKTOOLS}/loaderimage --pack --uboot ${OUTDIR}/u-boot.bin uboot.img ${UBOOT_LOAD_ADDR} ${PLATFORM_UBOOT_IMG_SIZE}; then
+		echo "pack uboot failed! Input: ${OUTDIR}/u-boot.bin"
+		exit 1
+	fi
 
 	# 删除中间生成的 u-boot.img 和 u-boot-dtb.img，避免用户混淆（最终镜像是 uboot.img）
 	if [ -f ${OUTDIR}/u-boot.img ]; then
@@ -925,6 +935,12 @@ pack_spl_loader_image()
 	ls ./*_loader_*.bin
 }
 
+# boot_merger 同时生成 idbloader.img 的参数（rkpack 也将其计入 loader 的 key）
+loader_idb_args()
+{
+	echo "--idb $(pwd)/idbloader.img"
+}
+
 ##
 # 打包 Loader 镜像函数：将 DDR 初始化代码和 Miniloader 打包成 loader.bin 和 idbloader.img
 # Loader 是 BootROM 加载的第一段代码，负责初始化 DDR 内存和加载 U-Boot
@@ -933,6 +949,10 @@ pack_loader_image()
 {
 	# 声明局部变量：mode 模式、files 文件列表、ini 配置文件路径
 	local mode=$1 files ini=${RKBIN}/RKBOOT/${RKCHIP_LOADER}MINIALL.ini
+	# idbloader.img（用于 SD 卡启动）由 boot_merger 在打包 loader 时一并生成，
+	# 需要使用本源码树编译的 boot_merger（支持 --idb），而不是 rkbin 中预编译的版本
+	local merger=$(pwd)/${RKTOOLS}/boot_merger
+	local idb=$(loader_idb_args)
 
 	# 如果用户指定了自定义 ini 文件
 	if [ "$FILE" != "" ]; then
@@ -942,7 +962,7 @@ pack_loader_image()
 	# 检查 ini 文件是否存在
 	if [ ! -f $ini ]; then
 		echo "pack loader failed! Can't find: $ini"
-		return
+		return 1
 	fi
 
 	# 删除旧的 loader 文件
@@ -958,37 +978,26 @@ pack_loader_image()
 		for ini in $files
 		do
 			if [ -f "$ini" ]; then
-				# 使用 boot_merger 工具打包
-				${RKTOOLS}/boot_merger ${BIN_PATH_FIXUP} $ini
+				# 使用 boot_merger 工具打包，只有默认 ini 同时生成 idbloader.img
+				if [ "$ini" = "${RKBIN}/RKBOOT/${RKCHIP_LOADER}MINIALL.ini" ]; then
+					${merger} ${BIN_PATH_FIXUP} ${idb} $ini || exit 1
+				else
+					${merger} ${BIN_PATH_FIXUP} $ini || exit 1
+				fi
 				echo "pack loader okay! Input: $ini"
 			fi
 		done
 	# 否则只打包指定的单个 loader
 	else
-		${RKTOOLS}/boot_merger ${BIN_PATH_FIXUP} $ini
+		if ! ${merger} ${BIN_PATH_FIXUP} ${idb} $ini; then
+			echo "pack loader failed! Input: $ini"
+			exit 1
+		fi
 		echo "pack loader okay! Input: $ini"
 	fi
 
 	# 切换回原目录并移动生成的 loader 文件
 	cd - && mv ${RKBIN}/*_loader_*.bin ./
-
-	# 生成 idbloader.img（用于 SD 卡启动）
-	# 从 ini 文件中提取 FlashData（DDR 初始化代码）的路径
-	local temp=`grep FlashData= ${RKBIN}/RKBOOT/${RKCHIP_LOADER}MINIALL.ini | cut -f 2 -d "="`
-	local flashData=${temp/tools\/rk_tools\//}  # 去除路径前缀
-	# 从 ini 文件中提取 FlashBoot（Miniloader）的路径
-	temp=`grep FlashBoot= ${RKBIN}/RKBOOT/${RKCHIP_LOADER}MINIALL.ini | cut -f 2 -d "="`
-	local flashBoot=${temp/tools\/rk_tools\//}
-	# 将芯片名称转换为小写
-	typeset -l localChip
-	localChip=$RKCHIP
-	# 使用 mkimage 生成 SD 卡启动镜像（-T rksd 表示 Rockchip SD 格式）
-	${RKTOOLS}/mkimage -n ${localChip} -T rksd -d ${RKBIN}/${flashData} idbloader.img
-	# 将 Miniloader 追加到 idbloader.img 后面
-	cat ${RKBIN}/${flashBoot} >> idbloader.img
-
-	# 注释掉的旧命令（功能已在上面实现）
-	#    cd - && mv ${RKBIN}/*_loader_*.bin ./ && mv ${RKBIN}/idbloader.img ./
 }
 
 ##
@@ -1003,7 +1012,7 @@ __pack_32bit_trust_image()
 	# 检查 ini 文件是否存在
 	if [ ! -f ${ini} ]; then
 		echo "pack trust failed! Can't find: ${ini}"
-		return
+		return 1
 	fi
 
 	# 从 ini 文件解析原始路径
@@ -1039,9 +1048,9 @@ __pack_32bit_trust_image()
 	# 使用 loaderimage 工具打包 Trust 镜像
 	# 优先使用 TOSTA，如果没有则使用 TOS
 	if [ $TOS_TA ]; then
-		${RKTOOLS}/loaderimage --pack --trustos ${RKBIN}/${TOS_TA} ${TEE_OUTPUT} ${TEE_LOAD_ADDR} ${PLATFORM_TRUST_IMG_SIZE}
+		${RKTOOLS}/loaderimage --pack --trustos ${RKBIN}/${TOS_TA} ${TEE_OUTPUT} ${TEE_LOAD_ADDR} ${PLATFORM_TRUST_IMG_SIZE} || exit 1
 	elif [ $TOS ]; then
-		${RKTOOLS}/loaderimage --pack --trustos ${RKBIN}/${TOS}    ${TEE_OUTPUT} ${TEE_LOAD_ADDR} ${PLATFORM_TRUST_IMG_SIZE}
+		${RKTOOLS}/loaderimage --pack --trustos ${RKBIN}/${TOS}    ${TEE_OUTPUT} ${TEE_LOAD_ADDR} ${PLATFORM_TRUST_IMG_SIZE} || exit 1
 	else
 		echo "Can't find any tee bin"
 		exit 1
@@ -1063,7 +1072,7 @@ __pack_64bit_trust_image()
 	# 检查 ini 文件是否存在
 	if [ ! -f ${ini} ]; then
 		echo "pack trust failed! Can't find: ${ini}"
-		return
+		return 1
 	fi
 
 	# 切换到 rkbin 目录进行打包
@@ -1076,8 +1085,11 @@ __pack_64bit_trust_image()
 	#   BIN_PATH_FIXUP: 路径替换参数（--replace tools/rk_tools/ ./）
 	#   PACK_IGNORE_BL32: 是否忽略 BL32（如 --ignore-bl32）
 	#   ini: TRUST 配置文件路径（包含 BL31、BL32 等路径信息）
-	${RKTOOLS}/trust_merger ${PLATFORM_SHA} ${PLATFORM_RSA} ${PLATFORM_TRUST_IMG_SIZE} ${BIN_PATH_FIXUP} \
-				${PACK_IGNORE_BL32} ${ini}
+	if ! ${RKTOOLS}/trust_merger ${PLATFORM_SHA} ${PLATFORM_RSA} ${PLATFORM_TRUST_IMG_SIZE} ${BIN_PATH_FIXUP} \
+				${PACK_IGNORE_BL32} ${ini}; then
+		echo "pack trust failed! Input: ${ini}"
+		exit 1
+	fi
 
 	# 切换回原目录并移动生成的 trust*.img 文件
 	cd - && mv ${RKBIN}/trust*.img ./
@@ -1142,6 +1154,199 @@ pack_trust_image()
 	fi
 }
 
+##
+# rkpack：用一份清单并行打包 uboot.img、loader（含 idbloader.img）和 trust.img
+#
+# 清单格式（每行 KEY=VALUE，# 开头为注释，省略的项使用与完整编译相同的默认值）：
+#   LOADER=<loader ini>    默认 RKBOOT/${RKCHIP_LOADER}MINIALL.ini
+#   TRUST=<trust ini>      默认 RKTRUST/${RKCHIP_TRUST}TRUST.ini（ARM32 为 TOS.ini）
+#   DIGEST=<摘要清单>      默认 ./rkpack.sha256
+# ini 的相对路径按 rkbin 目录解析
+#
+# 所有输入（u-boot.bin、ini 及其引用的二进制、打包工具）只调用一次 sha256sum，
+# 多个镜像共用的输入不会重复计算；每个镜像的 key 由打包参数和其输入的摘要组成，
+# key 未变化且上次的输出未被修改时跳过该镜像。
+# 需要打包的镜像在子 shell 中并行执行，日志和 key 记录在 ${OUTDIR}/.rkpack/，
+# 完成后所有输出的 sha256 写入摘要清单（可用 sha256sum -c 校验）
+##
+RKPACK_IMAGES="uboot loader trust"
+
+# 判断 trust 是否由 trust_merger 打包（ARM64 及 ARM64 以 AArch32 启动）
+rkpack_trust_is_64bit()
+{
+	grep -Eq '^CONFIG_ARM64=y|^CONFIG_ARM64_BOOT_AARCH32=y' ${OUTDIR}/.config
+}
+
+# 列出 ini 及其引用的、存在于 rkbin 中的文件（路径前缀按 BIN_PATH_FIXUP 修正）
+rkpack_ini_inputs()
+{
+	local ini=$1 path
+
+	echo ${ini}
+	for path in `sed -n 's/^[^#;]*=//p' ${ini} | tr -d '\r' | sed 's#tools/rk_tools/#./#'`
+	do
+		if [ -f ${RKBIN}/${path} ]; then
+			echo ${RKBIN}/${path}
+		fi
+	done
+}
+
+# 列出镜像的输入文件（绝对路径，每行一个）
+# 用法: rkpack_inputs <镜像> <ini>
+rkpack_inputs()
+{
+	case $1 in
+		uboot)
+		echo ${OUTDIR}/u-boot.bin ${OUTDIR}/.config ${RKTOOLS}/loaderimage
+		;;
+		loader)
+		rkpack_ini_inputs $2
+		echo ${RKTOOLS}/boot_merger
+		;;
+		trust)
+		rkpack_ini_inputs $2
+		if rkpack_trust_is_64bit; then
+			echo ${RKBIN}/tools/trust_merger
+		else
+			echo ${OUTDIR}/include/autoconf.mk ${RKTOOLS}/loaderimage
+		fi
+		;;
+	esac | xargs -n1 readlink -m
+}
+
+# 列出镜像打包后的输出文件
+rkpack_outputs()
+{
+	case $1 in
+		uboot)  ls uboot.img ;;
+		loader) ls *_loader_*.bin idbloader.img ;;
+		trust)  ls trust*.img ;;
+	esac 2>/dev/null
+}
+
+# 打包单个镜像（在子 shell 中执行，ini 通过 FILE 传给原有的打包函数）
+rkpack_run()
+{
+	FILE=$2
+	case $1 in
+		uboot)  pack_uboot_image ;;
+		loader) pack_loader_image ;;
+		trust)  pack_trust_image ;;
+	esac
+}
+
+rkpack_images()
+{
+	local manifest=$1 digest=./rkpack.sha256 dir=${OUTDIR}/.rkpack
+	local name key value file sum rc failed
+	local -A ini sums keys pids
+
+	ini[loader]=${RKBIN}/RKBOOT/${RKCHIP_LOADER}MINIALL.ini
+	if rkpack_trust_is_64bit; then
+		ini[trust]=${RKBIN}/RKTRUST/${RKCHIP_TRUST}TRUST.ini
+	else
+		ini[trust]=${RKBIN}/RKTRUST/${RKCHIP_TRUST}TOS.ini
+	fi
+
+	# 解析清单
+	if [ "${manifest}" != "" ]; then
+		if [ ! -f ${manifest} ]; then
+			echo "rkpack failed! Can't find manifest: ${manifest}"
+			exit 1
+		fi
+		while IFS='=' read key value
+		do
+			key=`echo ${key}`
+			value=`echo ${value}`
+			case ${key} in
+				''|\#*)
+				;;
+				LOADER|TRUST)
+				if [ "${value:0:1}" != "/" ]; then
+					value=${RKBIN}/${value}
+				fi
+				ini[${key,,}]=${value}
+				;;
+				DIGEST)
+				digest=${value}
+				;;
+				*)
+				echo "rkpack failed! Unknown manifest key: ${key}"
+				exit 1
+				;;
+			esac
+		done < <(tr -d '\r' < ${manifest})
+	fi
+
+	for name in loader trust
+	do
+		if [ ! -f ${ini[$name]} ]; then
+			echo "rkpack failed! Can't find ${name} ini: ${ini[$name]}"
+			exit 1
+		fi
+	done
+
+	# 所有镜像的输入去重后一次性计算 sha256
+	while read sum file
+	do
+		sums[$file]=${sum}
+	done < <(for name in ${RKPACK_IMAGES}; do rkpack_inputs ${name} ${ini[$name]}; done \
+		| sort -u | while read file; do [ -f ${file} ] && echo ${file}; done \
+		| xargs -r sha256sum)
+
+	mkdir -p ${dir}
+	for name in ${RKPACK_IMAGES}
+	do
+		# key: 打包参数（含路径修正和 loader 的 --idb）+ 每个输入的摘要（不存在的输入记为 missing）
+		keys[$name]=`(echo ${name} ${ini[$name]} ${PLATFORM_RSA} ${PLATFORM_SHA} \
+				${PLATFORM_UBOOT_IMG_SIZE} ${PLATFORM_TRUST_IMG_SIZE} ${PACK_IGNORE_BL32}
+			case ${name} in
+				loader) echo ${BIN_PATH_FIXUP} $(loader_idb_args) ;;
+				trust)  echo ${BIN_PATH_FIXUP} ;;
+			esac
+			for file in $(rkpack_inputs ${name} ${ini[$name]}); do
+				echo "${sums[$file]:-missing} ${file}"
+			done) | sha256sum | cut -c1-16`
+
+		if [ -f ${dir}/${name}.key ] && [ "$(cat ${dir}/${name}.key)" = "${keys[$name]}" ] &&
+		   sha256sum --status -c ${dir}/${name}.sha256 2>/dev/null; then
+			echo "rkpack: ${name} is up to date"
+			continue
+		fi
+
+		# 先删除旧的 key 和输出，打包失败时不会把旧输出当作新 key 的结果记录
+		rm -f ${dir}/${name}.key ${dir}/${name}.sha256 $(rkpack_outputs ${name})
+		echo "rkpack: packing ${name}, log: ${dir}/${name}.log"
+		( rkpack_run ${name} ${ini[$name]} ) > ${dir}/${name}.log 2>&1 &
+		pids[$name]=$!
+	done
+
+	# 等待所有镜像打包完成，打包工具成功后才记录 key 和输出摘要
+	failed=
+	for name in ${!pids[@]}
+	do
+		rc=0
+		wait ${pids[$name]} || rc=$?
+		cat ${dir}/${name}.log
+		if [ $rc != 0 ] || [ -z "$(rkpack_outputs ${name})" ]; then
+			echo "rkpack: pack ${name} failed!"
+			failed=1
+			continue
+		fi
+		sha256sum $(rkpack_outputs ${name}) > ${dir}/${name}.sha256
+		echo ${keys[$name]} > ${dir}/${name}.key
+	done
+	if [ "${failed}" != "" ]; then
+		exit 1
+	fi
+
+	for name in ${RKPACK_IMAGES}
+	do
+		cat ${dir}/${name}.sha256
+	done > ${digest}
+	echo "rkpack okay! Digests: ${digest}"
+}
+
 ##
 # 完成提示函数：显示构建完成信息
 ##
@@ -1172,11 +1377,9 @@ fixup_platform_configure
 sub_commands
 # 6. 执行 make 编译 U-Boot（生成 u-boot.bin）
 make CROSS_COMPILE=${TOOLCHAIN_GCC}  all --jobs=${JOB} ${OUTOPT}
-# 7. 打包 U-Boot 镜像（u-boot.bin -> uboot.img）
-pack_uboot_image
-# 8. 打包 Loader 镜像（DDR init + Miniloader -> loader.bin + idbloader.img）
-pack_loader_image
-# 9. 打包 Trust 镜像（ATF + OP-TEE -> trust.img）
-pack_trust_image
-# 10. 显示完成信息
+# 7. 并行打包 U-Boot 镜像（u-boot.bin -> uboot.img）、
+#    Loader 镜像（DDR init + Miniloader -> loader.bin + idbloader.img）
+#    和 Trust 镜像（ATF + OP-TEE -> trust.img），输出摘要写入 rkpack.sha256
+rkpack_images
+# 8. 显示完成信息
 finish
@@ -7,11 +7,16 @@
  *   - 支持从 INI 配置文件读取组件路径
  *   - 添加 Rockchip 专用镜像头部(magic, chip type, version, CRC 等)
  *   - 支持 RC4 加密和镜像解包
+ *   - 支持在同一次打包中生成 idbloader.img(--idb)
+ *   - 支持只读检查镜像(--info),以 JSON 格式输出头部和各 Entry 信息
  *
  * SPDX-License-Identifier:	GPL-2.0+
  */
 #include "boot_merger.h"
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <version.h>
 
@@ -32,11 +37,13 @@ options gOpts;                          /* 解析后的配置选项(芯片类型
 char gLegacyPath[MAX_LINE_LEN] = { 0 }; /* 旧路径字符串,用于路径替换 */
 char gNewPath[MAX_LINE_LEN] = { 0 };    /* 新路径字符串,用于路径替换 */
 static char *gPrePath;                  /* 路径前缀,用于拼接相对路径 */
+static char *gIdbPath;                  /* idbloader.img 输出路径(NULL 则不生成) */
 char gSubfix[MAX_LINE_LEN] = OUT_SUBFIX;/* 输出文件名后缀 */
 char gEat[MAX_LINE_LEN];                /* 用于读取并丢弃 INI 文件中的无用字符 */
 char *gConfigPath;                      /* INI 配置文件路径 */
 uint8_t *gBuf;                          /* 全局缓冲区,用于文件读写操作 */
 bool enableRC4 = false;                 /* RC4 加密使能标志(默认禁用) */
+bool gCheck = false;                    /* --info 时是否校验 CRC 并解密各 Entry */
 
 static uint32_t g_merge_max_size = MAX_MERGE_SIZE;  /* 合并镜像最大尺寸(默认值) */
 
@@ -909,11 +916,43 @@ static inline rk_time getTime(void)
 	return rkTime;
 }
 
+/* idbloader.img 中的一个组件(FlashData 或 FlashBoot) */
+typedef struct {
+	FILE *file;         /* idbloader.img 文件指针 */
+	uint32_t offset;    /* 组件在 idbloader.img 中的偏移 */
+	const char *tag;    /* 非 NULL 时覆盖组件前 4 字节(SPL 头) */
+	bool pad;           /* 是否写入补齐部分(DDR 代码需要对齐到 2KB) */
+} idb_part;
+
+/**
+ * writeIdbPart - 将组件写入 idbloader.img
+ * @idb: 组件信息
+ * @first: 组件首块(512 字节,已替换 SPL 头)
+ * @buf: 组件完整数据(首块之后的部分从这里取)
+ * @size: 写入的字节数
+ *
+ * 返回: true=成功, false=写入失败
+ */
+static bool writeIdbPart(const idb_part *idb, const uint8_t *first,
+                         const uint8_t *buf, uint32_t size)
+{
+	uint32_t len = size < SMALL_PACKET ? size : SMALL_PACKET;
+
+	if (fseek(idb->file, idb->offset, SEEK_SET))
+		return false;
+	if (!fwrite(first, len, 1, idb->file))
+		return false;
+	if (size > len && !fwrite(buf + len, size - len, 1, idb->file))
+		return false;
+	return true;
+}
+
 /**
  * writeFile - 读取文件内容并写入到输出镜像(支持 RC4 加密和对齐)
  * @outFile: 输出文件指针
  * @path: 待写入的源文件路径
  * @fix: 是否使用固定分块大小(true=512字节分块加密, false=整体加密)
+ * @idb: 非 NULL 时同时将该组件写入 idbloader.img(仅用于 fix 模式)
  *
  * 功能:
  *   1. 读取源文件到全局缓冲区 gBuf
@@ -927,12 +966,17 @@ static inline rk_time getTime(void)
  *   - 先补齐到 SMALL_PACKET(512字节) 倍数
  *   - 再补齐到 ENTRY_ALIGN(2048字节) 倍数
  *
+ * idbloader.img 复用已读入的数据: 未启用 RC4 时写入明文,
+ * 启用 RC4 时写入与 loader.bin 相同的分块加密数据(仅首块因 SPL 头不同而单独加密)
+ *
  * 返回: true=成功, false=失败(文件读取或写入错误)
  */
-static bool writeFile(FILE *outFile, const char *path, bool fix)
+static bool writeFile(FILE *outFile, const char *path, bool fix,
+                      const idb_part *idb)
 {
 	bool ret = false;
-	uint32_t size = 0, fixSize = 0;
+	uint32_t size = 0, fixSize = 0, idbSize = 0;
+	uint8_t first[SMALL_PACKET];
 	uint8_t *buf;
 
 	FILE *inFile = fopen(path, "rb");
@@ -960,6 +1004,16 @@ static bool writeFile(FILE *outFile, const char *path, bool fix)
 	if (!fread(gBuf, size, 1, inFile))
 		goto end;
 
+	/* === idbloader.img: 保存首块并替换 SPL 头,未启用 RC4 时直接写入明文 === */
+	if (idb) {
+		idbSize = idb->pad ? fixSize : size;
+		memcpy(first, gBuf, SMALL_PACKET);
+		if (idb->tag)
+			memcpy(first, idb->tag, IDB_SPL_HDR_SIZE);
+		if (!enableRC4 && !writeIdbPart(idb, first, gBuf, idbSize))
+			goto end;
+	}
+
 	/* === RC4 加密(如果启用) === */
 	if (fix) {
 		/* 固定模式: 分块加密(每 512 字节一块) */
@@ -981,6 +1035,13 @@ static bool writeFile(FILE *outFile, const char *path, bool fix)
 		P_RC4(gBuf, size);  /* 加密整个数据块 */
 	}
 
+	/* === idbloader.img: 启用 RC4 时写入分块加密后的数据 === */
+	if (idb && enableRC4) {
+		P_RC4(first, SMALL_PACKET);
+		if (!writeIdbPart(idb, first, gBuf, idbSize))
+			goto end;
+	}
+
 	/* 写入加密后的数据到输出文件 */
 	if (!fwrite(gBuf, size, 1, outFile))
 		goto end;
@@ -1247,6 +1308,67 @@ end:
 	return crc;
 }
 
+/**
+ * findLoader - 按名称查找 Loader 组件
+ * @name: 组件名称(如 FlashData, FlashBoot)
+ *
+ * 返回: 组件在 gOpts.loader 中的索引, 未找到返回 -1
+ */
+static int findLoader(const char *name)
+{
+	int i;
+
+	for (i = 0; i < gOpts.loaderNum; i++) {
+		if (!strcmp(gOpts.loader[i].name, name))
+			return i;
+	}
+	return -1;
+}
+
+/**
+ * writeIdbHeader - 写入 idbloader.img 头部(0x0 ~ 0x800)
+ * @file: idbloader.img 文件指针
+ * @ddrPath: DDR 初始化代码(FlashData)路径
+ * @bootOffset: 输出 Miniloader 在 idbloader.img 中的偏移
+ *
+ * 与 mkimage -n <chip> -T rksd -d <ddr.bin> 生成的头部相同:
+ *   - initSize: DDR 代码对齐到 2KB 后的扇区数
+ *   - initBootSize: initSize + IDB_MAX_BOOT_SIZE 对应的扇区数
+ *   - disableRc4: 未启用 --rc4 时为 1
+ * 头部本身总是经过 RC4 加密
+ *
+ * 返回: true=成功, false=失败
+ */
+static bool writeIdbHeader(FILE *file, const char *ddrPath,
+                           uint32_t *bootOffset)
+{
+	uint8_t buf[IDB_INIT_OFFSET * SMALL_PACKET];
+	rk_idb_header *hdr = (rk_idb_header *)buf;
+	uint32_t size;
+
+	if (!getFileSize(ddrPath, &size) || !size) {
+		LOGE("idb: cannot get size of %s\n", ddrPath);
+		return false;
+	}
+	/* 与 saveEntry 的 fix 模式相同: 先补齐到 512 字节,再补齐到 2KB */
+	size = ((size - 1) / SMALL_PACKET + 1) * SMALL_PACKET;
+	size += size % ENTRY_ALIGN ? ENTRY_ALIGN - size % ENTRY_ALIGN : 0;
+
+	memset(buf, 0, sizeof(buf));
+	hdr->signature = IDB_SIGNATURE;
+	hdr->disableRc4 = !enableRC4;
+	hdr->initOffset = IDB_INIT_OFFSET;
+	hdr->initSize = size / SMALL_PACKET;
+	hdr->initBootSize = hdr->initSize + IDB_MAX_BOOT_SIZE / SMALL_PACKET;
+	P_RC4(buf, sizeof(rk_idb_header));
+
+	if (!fwrite(buf, sizeof(buf), 1, file))
+		return false;
+
+	*bootOffset = sizeof(buf) + size;
+	return true;
+}
+
 /**
  * mergeBoot - 合并 Boot 镜像的核心函数
  * @argc: 命令行参数数量
@@ -1281,6 +1403,9 @@ end:
  *   5. 依次写入所有组件数据(加密)
  *   6. 计算并写入 CRC32 校验值
  *
+ * 指定 --idb 时,写入 FlashData/FlashBoot 数据的同时生成 idbloader.img,
+ * SPL 头取芯片名称的前 4 个字符(如 RK330C -> RK33)
+ *
  * 返回: true=成功生成镜像, false=失败
  */
 static bool mergeBoot(int argc, char **argv)
@@ -1289,6 +1414,10 @@ static bool mergeBoot(int argc, char **argv)
 	bool ret = false;
 	int i;
 	FILE *outFile;
+	FILE *idbFile = NULL;
+	idb_part idb[2];      /* [0]: FlashData, [1]: FlashBoot */
+	int idbIndex[2] = { -1, -1 };
+	char splHdr[IDB_SPL_HDR_SIZE];
 	uint32_t crc;
 	rk_boot_header hdr;
 
@@ -1325,6 +1454,34 @@ static bool mergeBoot(int argc, char **argv)
 		goto end;
 	}
 
+	/* === 可选: 创建 idbloader.img 并写入头部 === */
+	if (gIdbPath) {
+		idbIndex[0] = findLoader(DEF_LOADER0);
+		idbIndex[1] = findLoader(DEF_LOADER1);
+		if (idbIndex[0] < 0 || idbIndex[1] < 0) {
+			LOGE("idb needs both " DEF_LOADER0 " and " DEF_LOADER1 "\n");
+			goto end;
+		}
+		idbFile = fopen(gIdbPath, "wb");
+		if (!idbFile) {
+			LOGE("open idb file(%s) failed\n", gIdbPath);
+			goto end;
+		}
+
+		memset(splHdr, 0, sizeof(splHdr));
+		memcpy(splHdr, gOpts.chip, strnlen(gOpts.chip, sizeof(splHdr)));
+
+		idb[0].file = idb[1].file = idbFile;
+		idb[0].offset = IDB_INIT_OFFSET * SMALL_PACKET;
+		idb[0].tag = splHdr;
+		idb[0].pad = true;
+		idb[1].tag = NULL;
+		idb[1].pad = false;
+		if (!writeIdbHeader(idbFile, gOpts.loader[idbIndex[0]].path,
+		                    &idb[1].offset))
+			goto end;
+	}
+
 	/* === 步骤 4: 生成并写入镜像头部 === */
 	getBoothdr(&hdr);
 	LOGD("write hdr\n");
@@ -1365,21 +1522,26 @@ static bool mergeBoot(int argc, char **argv)
 	LOGD("write code 471\n");
 	for (i = 0; i < gOpts.code471Num; i++) {
 		/* 写入 CODE471 数据,普通加密模式 */
-		if (!writeFile(outFile, (char *)gOpts.code471Path[i], false))
+		if (!writeFile(outFile, (char *)gOpts.code471Path[i], false, NULL))
 			goto end;
 	}
 
 	LOGD("write code 472\n");
 	for (i = 0; i < gOpts.code472Num; i++) {
 		/* 写入 CODE472 数据,普通加密模式 */
-		if (!writeFile(outFile, (char *)gOpts.code472Path[i], false))
+		if (!writeFile(outFile, (char *)gOpts.code472Path[i], false, NULL))
 			goto end;
 	}
 
 	LOGD("write loader\n");
 	for (i = 0; i < gOpts.loaderNum; i++) {
-		/* 写入 Loader 数据,分块加密模式 */
-		if (!writeFile(outFile, gOpts.loader[i].path, true))
+		/* 写入 Loader 数据,分块加密模式(FlashData/FlashBoot 同时写入 idbloader.img) */
+		const idb_part *part = NULL;
+		if (i == idbIndex[0])
+			part = &idb[0];
+		else if (i == idbIndex[1])
+			part = &idb[1];
+		if (!writeFile(outFile, gOpts.loader[i].path, true, part))
 			goto end;
 	}
 
@@ -1391,10 +1553,23 @@ static bool mergeBoot(int argc, char **argv)
 	if (!fwrite(&crc, sizeof(crc), 1, outFile))
 		goto end;
 
+	if (idbFile) {
+		if (fclose(idbFile)) {
+			idbFile = NULL;
+			goto end;
+		}
+		idbFile = NULL;
+		printf("idb success(%s)\n", gIdbPath);
+	}
+
 	ret = true;
 end:
 	if (outFile)
 		fclose(outFile);
+	if (idbFile)
+		fclose(idbFile);
+	if (!ret && gIdbPath)
+		remove(gIdbPath);
 	return ret;
 }
 
@@ -1550,6 +1725,297 @@ end:
 }
 
 /************unpack code end***********/
+/************info code*****************/
+
+/* --info 使用的只读文件映射,头部和 Entry 直接在映射上解析,不复制数据 */
+typedef struct {
+	const uint8_t *base;  /* 映射起始地址 */
+	size_t size;          /* 文件大小 */
+} loader_map;
+
+/**
+ * mapLoader - 以只读方式映射 loader 文件
+ * @path: loader.bin 文件路径
+ * @map: 输出的映射信息
+ *
+ * 返回: true=成功, false=文件无法打开或为空
+ */
+static bool mapLoader(const char *path, loader_map *map)
+{
+	struct stat st;
+	void *base;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return false;
+	if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+		close(fd);
+		return false;
+	}
+
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);  /* 映射建立后即可关闭文件描述符 */
+	if (base == MAP_FAILED)
+		return false;
+
+	map->base = base;
+	map->size = st.st_size;
+	return true;
+}
+
+static void unmapLoader(loader_map *map)
+{
+	if (map->base)
+		munmap((void *)map->base, map->size);
+	map->base = NULL;
+	map->size = 0;
+}
+
+/* 判断 [offset, offset + size) 是否完全位于映射范围内 */
+static inline bool inMap(const loader_map *map, uint64_t offset, uint64_t size)
+{
+	return offset <= map->size && size <= map->size - offset;
+}
+
+/* 输出 JSON 字符串(带引号),转义引号、反斜杠和控制字符 */
+static void printJsonString(const char *str)
+{
+	putchar('"');
+	for (; *str; str++) {
+		unsigned char c = *str;
+		if (c == '"' || c == '\\')
+			printf("\\%c", c);
+		else if (c < 0x20 || c >= 0x7f)
+			printf("\\u%04x", c);
+		else
+			putchar(c);
+	}
+	putchar('"');
+}
+
+/**
+ * getChipName - 将头部中的芯片类型 ID 还原为芯片名称
+ * @type: rk_boot_header.chipType
+ * @name: 输出缓冲区(至少 8 字节)
+ *
+ * 与 getChipType 相反: 预定义类型返回对应名称,
+ * 其他类型按 convertChipType 的编码还原 4 个字符(如 0x33333939 -> "3399")
+ *
+ * 返回: true=成功, false=无法识别
+ */
+static bool getChipName(uint32_t type, char *name)
+{
+	static const struct {
+		uint32_t type;
+		const char *name;
+	} chips[] = {
+		{ RK27_DEVICE, CHIP_RK27 },         { RKCAYMAN_DEVICE, CHIP_RKCAYMAN },
+		{ RK28_DEVICE, CHIP_RK28 },         { RK281X_DEVICE, CHIP_RK281X },
+		{ RKPANDA_DEVICE, CHIP_RKPANDA },   { RKNANO_DEVICE, CHIP_RKNANO },
+		{ RKSMART_DEVICE, CHIP_RKSMART },   { RKCROWN_DEVICE, CHIP_RKCROWN },
+		{ RK29_DEVICE, CHIP_RK29 },         { RK292X_DEVICE, CHIP_RK292X },
+		{ RK30_DEVICE, CHIP_RK30 },         { RK30B_DEVICE, CHIP_RK30B },
+		{ RK31_DEVICE, CHIP_RK31 },         { RK32_DEVICE, CHIP_RK32 },
+	};
+	int i;
+
+	for (i = 0; i < sizeof(chips) / sizeof(chips[0]); i++) {
+		if (chips[i].type == type) {
+			strcpy(name, chips[i].name);
+			return true;
+		}
+	}
+
+	for (i = 0; i < 4; i++) {
+		char c = (type >> (24 - i * 8)) & 0xFF;
+		if (c < 0x20 || c >= 0x7f)
+			return false;
+		name[i] = c;
+	}
+	name[4] = 0;
+	return true;
+}
+
+/**
+ * checkEntry - 解密单个 Entry 并计算明文 CRC32(--check)
+ * @map: loader 文件映射
+ * @entry: Entry 元数据(位于映射中)
+ * @crc: 输出的明文 CRC32
+ *
+ * 映射为只读,数据先复制到可复用的临时缓冲区再解密,不写任何文件。
+ * 解密方式与 unpackEntry 相同: Loader 类型按 512 字节分块, 其他类型整体解密
+ *
+ * 返回: true=成功, false=内存不足
+ */
+static bool checkEntry(const loader_map *map, const rk_boot_entry *entry,
+                       uint32_t *crc)
+{
+	static uint8_t *buf;
+	static uint32_t bufSize;
+	uint32_t size = entry->dataSize;
+	uint32_t i;
+
+	if (size > bufSize) {
+		uint8_t *tmp = realloc(buf, size);
+		if (!tmp)
+			return false;
+		buf = tmp;
+		bufSize = size;
+	}
+	memcpy(buf, map->base + entry->dataOffset, size);
+
+	if (entry->type == ENTRY_LOADER) {
+		for (i = 0; i < size; i += SMALL_PACKET)
+			P_RC4(buf + i, size - i < SMALL_PACKET ? size - i : SMALL_PACKET);
+	} else {
+		P_RC4(buf, size);
+	}
+
+	*crc = CRC_32(buf, size);
+	return true;
+}
+
+/**
+ * infoBoot - 以 JSON 格式输出 loader.bin 的头部和所有 Entry
+ * @path: loader.bin 文件路径
+ *
+ * 功能:
+ *   1. 只读映射整个文件,直接在映射上解析 rk_boot_header 和 rk_boot_entry
+ *   2. 输出版本、打包时间、芯片类型、各 Entry 的名称/类型/偏移/大小/延迟
+ *   3. 检查每个 Entry 的数据是否位于文件范围内
+ *   4. gCheck 为 true 时,校验镜像末尾的 CRC32,并解密每个 Entry 输出明文 CRC32
+ *
+ * 不分配 gBuf,也不写任何文件,适合批量检查大量 loader。
+ * 文件无法解析时输出包含 "error" 字段的对象
+ *
+ * 返回: true=镜像有效(且 gCheck 时 CRC 正确), false=失败
+ */
+static bool infoBoot(const char *path)
+{
+	static const struct {
+		rk_entry_type type;
+		const char *name;
+	} groups[] = {
+		{ ENTRY_471, "471" }, { ENTRY_472, "472" }, { ENTRY_LOADER, "loader" },
+	};
+	loader_map map = { NULL, 0 };
+	const rk_boot_header *hdr;
+	const rk_boot_entry *entry;
+	const char *error = NULL;
+	uint32_t num, offset, stride, crc;
+	char name[MAX_NAME_LEN + 1], chip[8];
+	bool first = true, ok = true;
+	int g, i;
+
+	printf("{\n\t\"path\": ");
+	printJsonString(path);
+
+	if (!mapLoader(path, &map)) {
+		error = "cannot map file";
+		goto end;
+	}
+	printf(",\n\t\"file_size\": %zu", map.size);
+
+	/* === 步骤 1: 校验头部 === */
+	hdr = (const rk_boot_header *)map.base;
+	if (map.size < sizeof(rk_boot_header) || hdr->tag != TAG) {
+		error = "bad loader tag";
+		goto end;
+	}
+
+	printf(",\n\t\"header_size\": %u", hdr->size);
+	printf(",\n\t\"version\": \"%x.%02x\"", (hdr->version >> 8) & 0xFF,
+	       hdr->version & 0xFF);
+	printf(",\n\t\"merger_version\": \"0x%08x\"", hdr->mergerVersion);
+	printf(",\n\t\"release_time\": \"%04u-%02u-%02u %02u:%02u:%02u\"",
+	       hdr->releaseTime.year, hdr->releaseTime.month, hdr->releaseTime.day,
+	       hdr->releaseTime.hour, hdr->releaseTime.minute,
+	       hdr->releaseTime.second);
+	printf(",\n\t\"chip_type\": \"0x%08x\"", hdr->chipType);
+	if (getChipName(hdr->chipType, chip)) {
+		printf(",\n\t\"chip\": ");
+		printJsonString(chip);
+	}
+	printf(",\n\t\"sign_flag\": %u", hdr->signFlag);
+	printf(",\n\t\"rc4_flag\": %u", hdr->rc4Flag);
+
+	/* === 步骤 2: 整个镜像的 CRC32(位于文件末尾 4 字节) === */
+	if (gCheck) {
+		uint32_t stored;
+		memcpy(&stored, map.base + map.size - sizeof(stored), sizeof(stored));
+		crc = CRC_32((uint8_t *)map.base, map.size - sizeof(stored));
+		printf(",\n\t\"crc32\": \"0x%08x\",\n\t\"crc_ok\": %s", stored,
+		       crc == stored ? "true" : "false");
+		if (crc != stored)
+			ok = false;
+	}
+
+	/* === 步骤 3: 依次解析三组 Entry 数组 === */
+	printf(",\n\t\"entries\": [");
+	for (g = 0; g < sizeof(groups) / sizeof(groups[0]); g++) {
+		if (groups[g].type == ENTRY_471) {
+			num = hdr->code471Num;
+			offset = hdr->code471Offset;
+			stride = hdr->code471Size;
+		} else if (groups[g].type == ENTRY_472) {
+			num = hdr->code472Num;
+			offset = hdr->code472Offset;
+			stride = hdr->code472Size;
+		} else {
+			num = hdr->loaderNum;
+			offset = hdr->loaderOffset;
+			stride = hdr->loaderSize;
+		}
+		if (!num)
+			continue;
+		if (stride < sizeof(rk_boot_entry) ||
+		    !inMap(&map, offset, (uint64_t)num * stride)) {
+			printf("\n\t]");
+			error = "entry table out of range";
+			goto end;
+		}
+
+		for (i = 0; i < num; i++) {
+			bool inBounds;
+
+			entry = (const rk_boot_entry *)(map.base + offset + i * stride);
+			wide2str(entry->name, name, MAX_NAME_LEN);
+			inBounds = inMap(&map, entry->dataOffset, entry->dataSize);
+			if (!inBounds)
+				ok = false;
+
+			printf("%s\n\t\t{ \"name\": ", first ? "" : ",");
+			printJsonString(name);
+			printf(", \"type\": \"%s\", \"offset\": %u, \"size\": %u, "
+			       "\"delay\": %u, \"in_bounds\": %s", groups[g].name,
+			       entry->dataOffset, entry->dataSize, entry->dataDelay,
+			       inBounds ? "true" : "false");
+			if (gCheck && inBounds) {
+				if (!checkEntry(&map, entry, &crc)) {
+					printf(" }\n\t]");
+					error = "out of memory";
+					goto end;
+				}
+				printf(", \"data_crc32\": \"0x%08x\"", crc);
+			}
+			printf(" }");
+			first = false;
+		}
+	}
+	printf("\n\t]");
+
+end:
+	if (error) {
+		printf(",\n\t\"error\": ");
+		printJsonString(error);
+		ok = false;
+	}
+	printf("\n}");
+	unmapLoader(&map);
+	return ok;
+}
+
+/************info code end*************/
 
 /**
  * printHelp - 打印帮助信息
@@ -1560,6 +2026,7 @@ end:
  *   模式 1: 基于 INI 配置文件
  *     boot_merger [--pack] <config.ini>
  *     boot_merger --unpack <loader.bin>
+ *     boot_merger --info [--check] <loader.bin>...
  *
  *   模式 2: 基于命令行参数(必须提供 5 个必需参数)
  *     boot_merger --pack -c <chip> -1 <471.bin> -2 <472.bin> -d <data.bin> -b <boot.bin>
@@ -1572,6 +2039,8 @@ static void printHelp(void)
 	printf("Options:\n");
 	printf("\t" OPT_MERGE "\t\t\tMerge loader with specified config.\n");
 	printf("\t" OPT_UNPACK "\t\tUnpack specified loader to current dir.\n");
+	printf("\t" OPT_INFO "\t\t\tPrint specified loaders as JSON, without unpacking.\n");
+	printf("\t" OPT_CHECK "\t\tWith " OPT_INFO ", verify image CRC and decrypt entries.\n");
 	printf("\t" OPT_VERBOSE "\t\tDisplay more runtime informations.\n");
 	printf("\t" OPT_HELP "\t\t\tDisplay this information.\n");
 	printf("\t" OPT_VERSION "\t\tDisplay version information.\n");
@@ -1580,6 +2049,7 @@ static void printHelp(void)
 	printf("\t" OPT_PREPATH "\t\tAdd prefix path of binary path.\n");
 	printf("\t" OPT_SIZE
 	       "\t\tImage size.\"--size [image KB size]\", must be 512KB aligned\n");
+	printf("\t" OPT_IDB "\t\t\tAlso write idbloader image.\"--idb [path]\"\n");
 
 	printf("Usage2: boot_merger [options] [parameter]\n");
 	printf("All below five option are must in this mode!\n");
@@ -1612,17 +2082,23 @@ static void printHelp(void)
  *   2. 解包模式: 将 loader.bin 拆分成各个组件
  *      boot_merger --unpack <loader.bin>
  *
+ *   3. 检查模式: 只读解析一个或多个 loader.bin,输出 JSON(多个文件时为数组)
+ *      boot_merger --info [--check] <loader.bin>...
+ *
  * 命令行选项:
  *   --verbose     启用调试模式,显示详细日志
  *   --help        显示帮助信息
  *   --version     显示版本信息
  *   --pack        明确指定合并模式
  *   --unpack      解包模式
+ *   --info        检查模式
+ *   --check       检查模式下校验 CRC 并解密各 Entry
  *   --rc4         启用 RC4 加密
  *   --subfix      指定输出文件后缀
  *   --replace     路径替换(旧路径 新路径)
  *   --prepath     添加路径前缀
  *   --size        指定镜像大小(KB,必须 512KB 对齐)
+ *   --idb         同时生成 idbloader.img(指定输出路径)
  *
  * 返回: 0=成功, -1=失败
  */
@@ -1631,6 +2107,7 @@ int main(int argc, char **argv)
 
 	int i;
 	bool merge = true;      /* 默认为合并模式 */
+	bool info = false;      /* 检查模式 */
 	char *optPath = NULL;   /* 配置文件路径或 loader.bin 路径 */
 
 	/* === 解析命令行选项 === */
@@ -1648,6 +2125,10 @@ int main(int argc, char **argv)
 			merge = true;
 		} else if (!strcmp(OPT_UNPACK, argv[i])) {  /* --unpack */
 			merge = false;
+		} else if (!strcmp(OPT_INFO, argv[i])) {  /* --info */
+			info = true;
+		} else if (!strcmp(OPT_CHECK, argv[i])) {  /* --check */
+			gCheck = true;
 		} else if (!strcmp(OPT_RC4, argv[i])) {  /* --rc4 */
 			printf("enable RC4 for IDB data(both ddr and preloader)\n");
 			enableRC4 = true;
@@ -1662,6 +2143,9 @@ int main(int argc, char **argv)
 		} else if (!strcmp(OPT_PREPATH, argv[i])) {  /* --prepath <前缀> */
 			i++;
 			gPrePath = argv[i];
+		} else if (!strcmp(OPT_IDB, argv[i])) {  /* --idb <idbloader 路径> */
+			i++;
+			gIdbPath = argv[i];
 		} else if (!strcmp(OPT_SIZE, argv[i])) {  /* --size <KB大小> */
 			g_merge_max_size = strtoul(argv[++i], NULL, 10);
 			/* 检查是否 512KB 对齐 */
@@ -1677,6 +2161,28 @@ int main(int argc, char **argv)
 		}
 	}
 
+	/* === 检查模式: 不需要全局缓冲区,剩余参数均为 loader 路径 === */
+	if (info) {
+		bool ok = true;
+		int n = argc - i;
+
+		if (!optPath) {
+			fprintf(stderr, "need set loader path to show info!\n");
+			printHelp();
+			return -1;
+		}
+		if (n > 1)
+			printf("[\n");
+		for (; i < argc; i++) {
+			if (!infoBoot(argv[i]))
+				ok = false;
+			printf("%s", i + 1 < argc ? ",\n" : "\n");
+		}
+		if (n > 1)
+			printf("]\n");
+		return ok ? 0 : -1;
+	}
+
 	/* 解包模式必须指定输出路径 */
 	if (!merge && !optPath) {
 		fprintf(stderr, "need set out path to unpack!\n");
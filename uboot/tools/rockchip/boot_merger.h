@@ -177,6 +177,26 @@ typedef struct {
 	uint32_t        dataSize;
 	uint32_t        dataDelay;
 } rk_boot_entry;
+
+/*
+ * idbloader.img(SD/eMMC 启动镜像)头部,与 mkimage -T rksd 生成的格式相同:
+ * 0x0 处为 RC4 加密的本头部, 0x800 处为 DDR 初始化代码(前 4 字节为 SPL 头),
+ * 其后紧跟 Miniloader
+ */
+#define IDB_SIGNATURE       0x0FF0AA55
+#define IDB_INIT_OFFSET     4           /* DDR 代码起始扇区 */
+#define IDB_SPL_HDR_SIZE    4
+#define IDB_MAX_BOOT_SIZE   (512 << 10)
+typedef struct {
+	uint32_t        signature;
+	uint8_t         reserved[4];
+	uint32_t        disableRc4;
+	uint16_t        initOffset;
+	uint8_t         reserved1[492];
+	uint16_t        initSize;       /* DDR 代码扇区数 */
+	uint16_t        initBootSize;   /* DDR 代码 + 下一级 loader 扇区数 */
+	uint8_t         reserved2[2];
+} rk_idb_header;
 #pragma pack()
 
 #define OPT_VERBOSE         "--verbose"
@@ -184,11 +204,14 @@ typedef struct {
 #define OPT_VERSION         "--version"
 #define OPT_MERGE           "--pack"
 #define OPT_UNPACK          "--unpack"
+#define OPT_INFO            "--info"
+#define OPT_CHECK           "--check"
 #define OPT_SUBFIX          "--subfix"
 #define OPT_REPLACE         "--replace"
 #define OPT_PREPATH         "--prepath"
 #define OPT_SIZE	    "--size"
 #define OPT_RC4		    "--rc4"
+#define OPT_IDB		    "--idb"
 
 #define OPT_CHIP	"-c"
 #define OPT_471		"-1"
@@ -3,6 +3,8 @@
  * (C) Copyright 2008-2015 Fuzhou Rockchip Electronics Co., Ltd
  */
 
+#define _FILE_OFFSET_BITS 64
+
 #include <errno.h>
 #include <memory.h>
 #include <stdint.h>
@@ -11,6 +13,9 @@
 #include <stdbool.h>
 #include <sys/stat.h>
 #include <time.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 /* #define DEBUG */
 
@@ -63,6 +68,54 @@ typedef struct {
 	uint32_t content_size;   /* bytes, size of resource content. */
 } index_tbl_entry;
 
+/*
+ * Version 1 keeps the v0 header fields and appends its own. The index table
+ * follows the contents: tbl_entry_num entries of entry_size bytes, sorted by
+ * (path_hash, path) for binary search, then the NUL terminated paths.
+ * tbl_offset and tbl_entry_size of the v0 fields are 0.
+ */
+#define RESOURCE_PTN_VERSION_V1 1
+#define INDEX_TBL_VERSION_V1 1
+
+/* checksums stored in each v1 entry. */
+#define RESOURCE_FLAG_CRC32 (1 << 0)
+#define RESOURCE_FLAG_SHA256 (1 << 1)
+#define SHA256_DIGEST_SIZE 32
+
+typedef struct {
+	char magic[4]; /* tag, "RSCE" */
+	uint16_t resource_ptn_version;
+	uint16_t index_tbl_version;
+	uint8_t header_size;    /* blocks, size of ptn header. */
+	uint8_t tbl_offset;     /* blocks, offset of index table, v0 only. */
+	uint8_t tbl_entry_size; /* blocks, size of index table's entry, v0 only. */
+	uint32_t tbl_entry_num; /* numbers of index table's entry. */
+	uint32_t entry_size;    /* bytes, size of index table's entry. */
+	uint32_t align;         /* bytes, alignment of resource contents. */
+	uint32_t flags;         /* RESOURCE_FLAG_*. */
+	uint32_t tbl_size;      /* bytes, entries and paths. */
+	uint64_t tbl_offset_v1; /* bytes, offset of index table. */
+	uint32_t tbl_crc;       /* CRC32 of the index table. */
+	uint32_t reserved;
+} resource_ptn_header_v1;
+
+/* compression of a v1 entry, in its flags. */
+#define RESOURCE_COMP_NONE 0
+#define RESOURCE_COMP_LZ4 1  /* LZ4 frame, independent blocks. */
+#define RESOURCE_COMP_ZSTD 2 /* zstd frame. */
+#define RESOURCE_COMP_MASK 0xff
+
+typedef struct {
+	uint32_t path_hash;      /* FNV-1a of path. */
+	uint32_t path_offset;    /* bytes, from the start of the index table. */
+	uint64_t content_offset; /* bytes, offset of resource content. */
+	uint64_t content_size;   /* bytes, size of resource content as stored. */
+	uint64_t orig_size;      /* bytes, size before compression. */
+	uint32_t flags;          /* RESOURCE_COMP_*. */
+	uint32_t crc32;          /* of the stored content, if RESOURCE_FLAG_CRC32. */
+	uint8_t sha256[SHA256_DIGEST_SIZE]; /* of the stored content, likewise. */
+} index_tbl_entry_v1;
+
 #define OPT_VERBOSE "--verbose"
 #define OPT_HELP "--help"
 #define OPT_VERSION "--version"
@@ -71,15 +124,25 @@ typedef struct {
 #define OPT_UNPACK "--unpack"
 #define OPT_TEST_LOAD "--test_load"
 #define OPT_TEST_CHARGE "--test_charge"
+#define OPT_READ "--read="
 #define OPT_IMAGE "--image="
 #define OPT_ROOT "--root="
+#define OPT_FORMAT "--format="
+#define OPT_ALIGN "--align="
+#define OPT_CHECKSUM "--checksum="
+#define OPT_COMPRESS "--compress="
 
 #define VERSION "2014-5-31 14:43:42"
 
 typedef struct {
 	char path[MAX_INDEX_ENTRY_PATH_LEN];
-	uint32_t content_offset; /* blocks, offset of resource content. */
-	uint32_t content_size;   /* bytes, size of resource content. */
+	uint64_t content_offset; /* blocks, offset of resource content. */
+	uint64_t content_size;   /* bytes, size of resource content as stored. */
+	uint64_t orig_size;      /* bytes, size of resource content. */
+	uint32_t comp;           /* RESOURCE_COMP_*. */
+	uint32_t flags;          /* RESOURCE_FLAG_*, checksums below valid. */
+	uint32_t crc32;
+	uint8_t sha256[SHA256_DIGEST_SIZE];
 	void *load_addr;
 } resource_content;
 
@@ -90,8 +153,57 @@ typedef struct {
 	char prefix[MAX_INDEX_ENTRY_PATH_LEN];
 } anim_level_conf;
 
+typedef struct {
+	int delay;
+	int only_current_level;
+	int level_num;
+	anim_level_conf *levels; /* sorted by max_level. */
+} anim_desc;
+
 #define DEF_CHARGE_DESC_PATH "charge_anim_desc.txt"
 
+/*
+ * The descriptor compiled at pack time: a charge_desc_bin header followed
+ * by level_num charge_level_bin, little endian like the rest of the image.
+ */
+#define CHARGE_DESC_BIN_PATH "charge_anim_desc.bin"
+#define CHARGE_DESC_BIN_MAGIC "CHGD"
+#define CHARGE_DESC_BIN_VERSION 1
+typedef struct {
+	char magic[4]; /* tag, "CHGD" */
+	uint32_t version;
+	uint32_t delay; /* ms, default for levels without their own. */
+	uint32_t only_current_level;
+	uint32_t level_num;
+} charge_desc_bin;
+
+typedef struct {
+	uint32_t max_level;
+	uint32_t num;   /* frames in the level's atlas. */
+	uint32_t delay; /* ms. */
+	uint32_t reserved;
+} charge_level_bin;
+
+/*
+ * All frames of level i, stored back to back after a charge_atlas_header
+ * and its offset table; the frames keep their own index entries too, which
+ * point into the atlas, so nothing is stored twice.
+ */
+#define CHARGE_ATLAS_PATH "charge_anim_level%d.atlas"
+#define CHARGE_ATLAS_MAGIC "ATLS"
+typedef struct {
+	char magic[4]; /* tag, "ATLS" */
+	uint32_t frame_num;
+} charge_atlas_header;
+
+typedef struct {
+	uint32_t offset; /* bytes, from the start of the atlas. */
+	uint32_t size;   /* bytes. */
+} charge_atlas_frame;
+
+/* frame j of a level: "<prefix>.bmp" if num=1, "<prefix><j>.bmp" otherwise */
+#define CHARGE_FRAME_SUBFIX ".bmp"
+
 #define OPT_CHARGE_ANIM_DELAY "delay="
 #define OPT_CHARGE_ANIM_LOOP_CUR "only_current_level="
 #define OPT_CHARGE_ANIM_LEVELS "levels="
@@ -106,6 +218,162 @@ static int fix_blocks(size_t size)
 	return (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
 }
 
+/* FNV-1a, the sort key of v1 index entries. */
+static uint32_t path_hash(const char *path)
+{
+	uint32_t hash = 2166136261u;
+	while (*path) {
+		hash ^= (uint8_t)*path++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/* same as crc32() in U-Boot (zlib), so the loader can check entries. */
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t len)
+{
+	static uint32_t table[256];
+	const uint8_t *p = (const uint8_t *)data;
+	int i, j;
+
+	if (!table[1]) {
+		for (i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (j = 0; j < 8; j++)
+				c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+	}
+	crc = ~crc;
+	while (len--)
+		crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+/*
+ * Standard SHA-256 (FIPS 180-2), same interface and digests as sha256_*()
+ * in U-Boot's lib/sha256.c. sha2.c is not used here: it is built with the
+ * byte order of the rockchip crypto engine for trust_merger.
+ */
+
+typedef struct {
+	uint64_t total; /* bytes hashed so far. */
+	uint32_t state[8];
+	uint8_t buffer[64];
+} sha256_context;
+
+#define SHA256_GET_BE32(b, i)                                                  \
+  (((uint32_t)(b)[i] << 24) | ((uint32_t)(b)[(i) + 1] << 16) |               \
+   ((uint32_t)(b)[(i) + 2] << 8) | (uint32_t)(b)[(i) + 3])
+
+static void sha256_put_be32(uint8_t *b, uint32_t v)
+{
+	b[0] = v >> 24;
+	b[1] = v >> 16;
+	b[2] = v >> 8;
+	b[3] = v;
+}
+
+static void sha256_starts(sha256_context *ctx)
+{
+	static const uint32_t init[8] = {
+		0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+		0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+	};
+
+	memset(ctx, 0, sizeof(*ctx));
+	memcpy(ctx->state, init, sizeof(init));
+}
+
+static void sha256_process(sha256_context *ctx, const uint8_t data[64])
+{
+	static const uint32_t k[64] = {
+		0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B,
+		0x59F111F1, 0x923F82A4, 0xAB1C5ED5, 0xD807AA98, 0x12835B01,
+		0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7,
+		0xC19BF174, 0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC,
+		0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA, 0x983E5152,
+		0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147,
+		0x06CA6351, 0x14292967, 0x27B70A85, 0x2E1B2138, 0x4D2C6DFC,
+		0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+		0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819,
+		0xD6990624, 0xF40E3585, 0x106AA070, 0x19A4C116, 0x1E376C08,
+		0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F,
+		0x682E6FF3, 0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208,
+		0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+	};
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+	uint32_t w[64], v[8], t1, t2;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = SHA256_GET_BE32(data, i * 4);
+	for (; i < 64; i++)
+		w[i] = (ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10)) +
+		       w[i - 7] +
+		       (ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+		       w[i - 16];
+
+	memcpy(v, ctx->state, sizeof(v));
+	for (i = 0; i < 64; i++) {
+		t1 = v[7] + (ROTR(v[4], 6) ^ ROTR(v[4], 11) ^ ROTR(v[4], 25)) +
+		     ((v[4] & v[5]) ^ (~v[4] & v[6])) + k[i] + w[i];
+		t2 = (ROTR(v[0], 2) ^ ROTR(v[0], 13) ^ ROTR(v[0], 22)) +
+		     ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+		memmove(v + 1, v, 7 * sizeof(v[0]));
+		v[4] += t1;
+		v[0] = t1 + t2;
+	}
+	for (i = 0; i < 8; i++)
+		ctx->state[i] += v[i];
+#undef ROTR
+}
+
+static void sha256_update(sha256_context *ctx, const uint8_t *input,
+                          size_t length)
+{
+	size_t left = ctx->total & 0x3F;
+	size_t fill = 64 - left;
+
+	ctx->total += length;
+
+	if (left && length >= fill) {
+		memcpy(ctx->buffer + left, input, fill);
+		sha256_process(ctx, ctx->buffer);
+		length -= fill;
+		input += fill;
+		left = 0;
+	}
+	while (length >= 64) {
+		sha256_process(ctx, input);
+		length -= 64;
+		input += 64;
+	}
+	if (length)
+		memcpy(ctx->buffer + left, input, length);
+}
+
+static void sha256_finish(sha256_context *ctx,
+                          uint8_t digest[SHA256_DIGEST_SIZE])
+{
+	static const uint8_t padding[64] = { 0x80 };
+	uint64_t bits = ctx->total << 3;
+	uint32_t last, padn;
+	uint8_t msglen[8];
+	int i;
+
+	sha256_put_be32(msglen, bits >> 32);
+	sha256_put_be32(msglen + 4, bits);
+
+	last = ctx->total & 0x3F;
+	padn = (last < 56) ? (56 - last) : (120 - last);
+	sha256_update(ctx, padding, padn);
+	sha256_update(ctx, msglen, 8);
+
+	for (i = 0; i < 8; i++)
+		sha256_put_be32(digest + i * 4, ctx->state[i]);
+}
+
 static const char *fix_path(const char *path)
 {
 	if (!memcmp(path, "./", 2)) {
@@ -138,12 +406,25 @@ static uint32_t switch_int(uint32_t x)
 	return val;
 }
 
-static void fix_header(resource_ptn_header *header)
+static uint64_t switch_long(uint64_t x)
+{
+	uint32_t *p = (uint32_t *)(&x);
+
+	return switch_int(p[0]) | (uint64_t)switch_int(p[1]) << 32;
+}
+
+static void fix_header(resource_ptn_header_v1 *header)
 {
 	/* switch for be. */
 	header->resource_ptn_version = switch_short(header->resource_ptn_version);
 	header->index_tbl_version = switch_short(header->index_tbl_version);
 	header->tbl_entry_num = switch_int(header->tbl_entry_num);
+	header->entry_size = switch_int(header->entry_size);
+	header->align = switch_int(header->align);
+	header->flags = switch_int(header->flags);
+	header->tbl_size = switch_int(header->tbl_size);
+	header->tbl_offset_v1 = switch_long(header->tbl_offset_v1);
+	header->tbl_crc = switch_int(header->tbl_crc);
 }
 
 static void fix_entry(index_tbl_entry *entry)
@@ -153,21 +434,66 @@ static void fix_entry(index_tbl_entry *entry)
 	entry->content_size = switch_int(entry->content_size);
 }
 
+static void fix_entry_v1(index_tbl_entry_v1 *entry)
+{
+	/* switch for be. */
+	entry->path_hash = switch_int(entry->path_hash);
+	entry->path_offset = switch_int(entry->path_offset);
+	entry->content_offset = switch_long(entry->content_offset);
+	entry->content_size = switch_long(entry->content_size);
+	entry->orig_size = switch_long(entry->orig_size);
+	entry->flags = switch_int(entry->flags);
+	entry->crc32 = switch_int(entry->crc32);
+}
+
 static int inline get_ptn_offset(void)
 {
 	return 0;
 }
 
-static bool StorageWriteLba(int offset_block, void *data, int blocks)
+/*
+ * The image last read from: the file stays open, and its header and index
+ * table are loaded once, for all lookups and reads that follow.
+ */
+static struct {
+	char path[MAX_INDEX_ENTRY_PATH_LEN];
+	FILE *file;
+	bool has_index;
+	resource_ptn_header_v1 hdr;
+	void *tbl;
+} image_cache;
+
+static void image_close(void)
+{
+	if (image_cache.file)
+		fclose(image_cache.file);
+	free(image_cache.tbl);
+	memset(&image_cache, 0, sizeof(image_cache));
+}
+
+static FILE *image_open(void)
+{
+	if (image_cache.file && !strcmp(image_cache.path, image_path))
+		return image_cache.file;
+	image_close();
+	image_cache.file = fopen(image_path, "rb");
+	if (image_cache.file)
+		snprintf(image_cache.path, sizeof(image_cache.path), "%s", image_path);
+	return image_cache.file;
+}
+
+static bool StorageWriteLba(uint64_t offset_block, void *data, int blocks)
 {
 	bool ret = false;
+	/* what is cached may change. */
+	image_close();
 	FILE *file = fopen(image_path, "rb+");
 	if (!file)
 		goto end;
-	int offset = offset_block * BLOCK_SIZE;
-	fseek(file, offset, SEEK_SET);
-	if (offset != ftell(file)) {
-		LOGE("Failed to seek %s to %d!", image_path, offset);
+	off_t offset = offset_block * BLOCK_SIZE;
+	fseeko(file, offset, SEEK_SET);
+	if (offset != ftello(file)) {
+		LOGE("Failed to seek %s to %lld!", image_path, (long long)offset);
 		goto end;
 	}
 	if (!fwrite(data, blocks * BLOCK_SIZE, 1, file)) {
@@ -181,28 +507,20 @@ end:
 	return ret;
 }
 
-static bool StorageReadLba(int offset_block, void *data, int blocks)
+static bool StorageReadLba(uint64_t offset_block, void *data, int blocks)
 {
-	bool ret = false;
-	FILE *file = fopen(image_path, "rb");
+	FILE *file = image_open();
 	if (!file)
-		goto end;
-	int offset = offset_block * BLOCK_SIZE;
-	fseek(file, offset, SEEK_SET);
-	if (offset != ftell(file)) {
-		goto end;
-	}
-	if (!fread(data, blocks * BLOCK_SIZE, 1, file)) {
-		goto end;
-	}
-	ret = true;
-end:
-	if (file)
-		fclose(file);
-	return ret;
+		return false;
+	off_t offset = offset_block * BLOCK_SIZE;
+	if (fseeko(file, offset, SEEK_SET) || offset != ftello(file))
+		return false;
+	if (!fread(data, blocks * BLOCK_SIZE, 1, file))
+		return false;
+	return true;
 }
 
-static bool write_data(int offset_block, void *data, size_t len)
+static bool write_data(uint64_t offset_block, void *data, size_t len)
 {
 	bool ret = false;
 	if (!data)
@@ -223,8 +541,507 @@ end:
 	return ret;
 }
 
+typedef struct {
+	uint32_t flags; /* RESOURCE_FLAG_*, checksums to compute. */
+	uint32_t crc32;
+	sha256_context sha256;
+} content_csum;
+
+static void csum_begin(content_csum *csum, uint32_t flags)
+{
+	csum->flags = flags;
+	csum->crc32 = 0;
+	if (flags & RESOURCE_FLAG_SHA256)
+		sha256_starts(&csum->sha256);
+}
+
+static void csum_update(content_csum *csum, const void *data, size_t len)
+{
+	if (csum->flags & RESOURCE_FLAG_CRC32)
+		csum->crc32 = crc32_update(csum->crc32, data, len);
+	if (csum->flags & RESOURCE_FLAG_SHA256)
+		sha256_update(&csum->sha256, (const uint8_t *)data, len);
+}
+
+/* stores the checksums into content. */
+static void csum_end(content_csum *csum, resource_content *content)
+{
+	content->flags = csum->flags;
+	content->crc32 = csum->crc32;
+	if (csum->flags & RESOURCE_FLAG_SHA256)
+		sha256_finish(&csum->sha256, content->sha256);
+}
+
+/* returns: false if content doesn't match the checksums of its entry. */
+static bool csum_check(content_csum *csum, resource_content *content)
+{
+	resource_content sum;
+
+	csum_end(csum, &sum);
+	if ((content->flags & RESOURCE_FLAG_CRC32) && sum.crc32 != content->crc32) {
+		LOGE("CRC32 mismatch:%s", content->path);
+		return false;
+	}
+	if ((content->flags & RESOURCE_FLAG_SHA256) &&
+	    memcmp(sum.sha256, content->sha256, sizeof(sum.sha256))) {
+		LOGE("SHA256 mismatch:%s", content->path);
+		return false;
+	}
+	return true;
+}
+
+/**********************compress************************/
+
+/*
+ * LZ4 frames as written by the lz4 tool and read by U-Boot's ulz4fn():
+ * 64KB independent blocks, content size in the header, no checksums (the
+ * index entry has its own).
+ */
+#define LZ4F_MAGIC 0x184d2204
+#define LZ4F_FLG (0x40 | 0x20 | 0x08) /* version 1, indep blocks, size. */
+#define LZ4F_BD 0x40                  /* 64KB blocks. */
+#define LZ4F_BLOCK_SIZE (64 * 1024)
+#define LZ4F_UNCOMPRESSED 0x80000000
+#define LZ4_HASH_BITS 12
+
+static uint32_t read_le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void write_le32(uint8_t *p, uint32_t val)
+{
+	p[0] = val;
+	p[1] = val >> 8;
+	p[2] = val >> 16;
+	p[3] = val >> 24;
+}
+
+static uint32_t rotl32(uint32_t x, int r)
+{
+	return (x << r) | (x >> (32 - r));
+}
+
+/* xxHash32, for the header checksum of LZ4 frames. */
+static uint32_t xxh32(const uint8_t *p, size_t len, uint32_t seed)
+{
+	const uint32_t p1 = 2654435761u, p2 = 2246822519u, p3 = 3266489917u;
+	const uint32_t p4 = 668265263u, p5 = 374761393u;
+	const uint8_t *end = p + len;
+	uint32_t h;
+
+	if (len >= 16) {
+		uint32_t v[4] = { seed + p1 + p2, seed + p2, seed, seed - p1 };
+		int i;
+		for (; p + 16 <= end; p += 16) {
+			for (i = 0; i < 4; i++)
+				v[i] = rotl32(v[i] + read_le32(p + i * 4) * p2, 13) * p1;
+		}
+		h = rotl32(v[0], 1) + rotl32(v[1], 7) + rotl32(v[2], 12) +
+		    rotl32(v[3], 18);
+	} else {
+		h = seed + p5;
+	}
+	h += len;
+	for (; p + 4 <= end; p += 4)
+		h = rotl32(h + read_le32(p) * p3, 17) * p4;
+	for (; p < end; p++)
+		h = rotl32(h + *p * p5, 11) * p1;
+	h ^= h >> 15;
+	h *= p2;
+	h ^= h >> 13;
+	h *= p3;
+	h ^= h >> 16;
+	return h;
+}
+
+static uint8_t *lz4_put_len(uint8_t *op, int len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+static uint8_t *lz4_put_seq(uint8_t *op, const uint8_t *lit, int lit_len,
+                            int offset, int match_len)
+{
+	uint8_t *token = op++;
+	*token = (lit_len < 15 ? lit_len : 15) << 4;
+	if (lit_len >= 15)
+		op = lz4_put_len(op, lit_len - 15);
+	memcpy(op, lit, lit_len);
+	op += lit_len;
+	if (!match_len)
+		return op;
+	*op++ = offset;
+	*op++ = offset >> 8;
+	match_len -= 4;
+	*token |= match_len < 15 ? match_len : 15;
+	if (match_len >= 15)
+		op = lz4_put_len(op, match_len - 15);
+	return op;
+}
+
+/*
+ * Greedy LZ4 block compressor, dst must hold len + len / 255 + 16 bytes.
+ *
+ * returns: compressed size
+ */
+static int lz4_compress_block(const uint8_t *src, int len, uint8_t *dst)
+{
+	int table[1 << LZ4_HASH_BITS];
+	int pos = 0, anchor = 0;
+	uint8_t *op = dst;
+	int i;
+
+	for (i = 0; i < (1 << LZ4_HASH_BITS); i++)
+		table[i] = -1;
+
+	/* the last match starts 12 bytes and ends 5 bytes before the end. */
+	while (pos + 12 <= len) {
+		uint32_t seq = read_le32(src + pos);
+		int h = (seq * 2654435761u) >> (32 - LZ4_HASH_BITS);
+		int ref = table[h];
+		table[h] = pos;
+		if (ref < 0 || pos - ref > 65535 || read_le32(src + ref) != seq) {
+			pos++;
+			continue;
+		}
+		int match_len = 4;
+		while (pos + match_len < len - 5 &&
+		       src[ref + match_len] == src[pos + match_len])
+			match_len++;
+		op = lz4_put_seq(op, src + anchor, pos - anchor, pos - ref, match_len);
+		pos += match_len;
+		anchor = pos;
+	}
+	op = lz4_put_seq(op, src + anchor, len - anchor, 0, 0);
+	return op - dst;
+}
+
+/* returns: decompressed size, -1 if src is corrupted */
+static int lz4_decompress_block(const uint8_t *src, int len, uint8_t *dst,
+                                int cap)
+{
+	const uint8_t *ip = src, *end = src + len;
+	uint8_t *op = dst;
+	int n;
+
+	while (ip < end) {
+		int token = *ip++;
+		n = token >> 4;
+		if (n == 15) {
+			do {
+				if (ip >= end)
+					return -1;
+				n += *ip;
+			} while (*ip++ == 255);
+		}
+		if (n > end - ip || n > dst + cap - op)
+			return -1;
+		memcpy(op, ip, n);
+		ip += n;
+		op += n;
+		if (ip == end)
+			break;
+
+		if (end - ip < 2)
+			return -1;
+		int offset = ip[0] | ip[1] << 8;
+		ip += 2;
+		if (!offset || offset > op - dst)
+			return -1;
+		n = (token & 15) + 4;
+		if ((token & 15) == 15) {
+			do {
+				if (ip >= end)
+					return -1;
+				n += *ip;
+			} while (*ip++ == 255);
+		}
+		if (n > dst + cap - op)
+			return -1;
+		/* may overlap, byte by byte. */
+		for (; n > 0; n--, op++)
+			*op = *(op - offset);
+	}
+	return op - dst;
+}
+
+/* returns: the LZ4 frame, NULL on error */
+static uint8_t *lz4_compress(const uint8_t *src, size_t len, size_t *out_len)
+{
+	size_t blocks = (len + LZ4F_BLOCK_SIZE - 1) / LZ4F_BLOCK_SIZE;
+	uint8_t *dst = (uint8_t *)malloc(
+	        19 + blocks * (4 + LZ4F_BLOCK_SIZE + LZ4F_BLOCK_SIZE / 255 + 16) + 4);
+	uint8_t *op = dst;
+	size_t pos;
+	int i;
+	if (!dst)
+		return NULL;
+
+	write_le32(op, LZ4F_MAGIC);
+	op += 4;
+	op[0] = LZ4F_FLG;
+	op[1] = LZ4F_BD;
+	for (i = 0; i < 8; i++)
+		op[2 + i] = (uint64_t)len >> (i * 8);
+	op[10] = xxh32(op, 10, 0) >> 8;
+	op += 11;
+
+	for (pos = 0; pos < len; pos += LZ4F_BLOCK_SIZE) {
+		int n = len - pos < LZ4F_BLOCK_SIZE ? len - pos : LZ4F_BLOCK_SIZE;
+		int size = lz4_compress_block(src + pos, n, op + 4);
+		if (size >= n) {
+			/* not compressible, store as is. */
+			memcpy(op + 4, src + pos, n);
+			size = n | LZ4F_UNCOMPRESSED;
+		}
+		write_le32(op, size);
+		op += 4 + (size & ~LZ4F_UNCOMPRESSED);
+	}
+	write_le32(op, 0);
+	op += 4;
+
+	*out_len = op - dst;
+	return dst;
+}
+
+/*
+ * Sequential reader of a stored entry: reads storage in chunks, checksums
+ * what it reads, so compressed entries never have to be loaded whole.
+ */
+#define STREAM_CHUNK_BLOCKS 32
+typedef struct {
+	resource_content *content;
+	uint64_t next_block; /* blocks, from the start of the content. */
+	uint64_t left;       /* bytes not yet read from storage. */
+	uint8_t buf[STREAM_CHUNK_BLOCKS * BLOCK_SIZE];
+	size_t len;          /* bytes in buf. */
+	size_t pos;          /* bytes of buf consumed. */
+	content_csum csum;
+} entry_stream;
+
+static void stream_open(entry_stream *st, resource_content *content)
+{
+	st->content = content;
+	st->next_block = 0;
+	st->left = content->content_size;
+	st->len = st->pos = 0;
+	csum_begin(&st->csum, content->flags);
+}
+
+/* returns: false at the end of the content or on a read error */
+static bool stream_fill(entry_stream *st)
+{
+	int blocks = fix_blocks(st->left);
+	if (!st->left)
+		return false;
+	if (blocks > STREAM_CHUNK_BLOCKS)
+		blocks = STREAM_CHUNK_BLOCKS;
+	if (!StorageReadLba(get_ptn_offset() + st->content->content_offset +
+	                    st->next_block, st->buf, blocks)) {
+		LOGE("Failed to read content:%s", st->content->path);
+		return false;
+	}
+	st->next_block += blocks;
+	st->len = st->left < sizeof(st->buf) ? st->left : sizeof(st->buf);
+	st->left -= st->len;
+	st->pos = 0;
+	csum_update(&st->csum, st->buf, st->len);
+	return true;
+}
+
+static bool stream_read(entry_stream *st, void *data, size_t len)
+{
+	uint8_t *p = (uint8_t *)data;
+	while (len > 0) {
+		if (st->pos == st->len && !stream_fill(st)) {
+			LOGE("Truncated content:%s", st->content->path);
+			return false;
+		}
+		size_t n = st->len - st->pos < len ? st->len - st->pos : len;
+		memcpy(p, st->buf + st->pos, n);
+		st->pos += n;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+typedef bool (*content_sink)(void *arg, const void *data, size_t len);
+
+static bool lz4_decode(entry_stream *st, content_sink sink, void *arg)
+{
+	bool ret = false;
+	uint8_t hdr[15];
+	uint8_t *in = NULL, *out = NULL;
+	int max, len;
+
+	if (!stream_read(st, hdr, 7) || read_le32(hdr) != LZ4F_MAGIC ||
+	    (hdr[4] & 0xc0) != 0x40) {
+		LOGE("Bad lz4 frame:%s", st->content->path);
+		goto end;
+	}
+	/* linked blocks and dictionaries are never written by --pack. */
+	if (!(hdr[4] & 0x20) || (hdr[4] & 0x01)) {
+		LOGE("Unsupported lz4 frame:%s", st->content->path);
+		goto end;
+	}
+	len = 7;
+	if (hdr[4] & 0x08) {
+		if (!stream_read(st, hdr + 7, 8))
+			goto end;
+		len += 8;
+	}
+	if (((xxh32(hdr + 4, len - 5, 0) >> 8) & 0xff) != hdr[len - 1]) {
+		LOGE("Bad lz4 frame header:%s", st->content->path);
+		goto end;
+	}
+	max = 1 << (8 + 2 * ((hdr[5] >> 4) & 7));
+	in = (uint8_t *)malloc(max);
+	out = (uint8_t *)malloc(max);
+	if (!in || !out)
+		goto end;
+
+	while (true) {
+		uint8_t word[4];
+		uint32_t size;
+		if (!stream_read(st, word, 4))
+			goto end;
+		size = read_le32(word);
+		if (!size)
+			break;
+		if ((size & ~LZ4F_UNCOMPRESSED) > max ||
+		    !stream_read(st, in, size & ~LZ4F_UNCOMPRESSED))
+			goto end;
+		if ((hdr[4] & 0x10) && !stream_read(st, word, 4))
+			goto end;
+		if (size & LZ4F_UNCOMPRESSED) {
+			if (!sink(arg, in, size & ~LZ4F_UNCOMPRESSED))
+				goto end;
+			continue;
+		}
+		len = lz4_decompress_block(in, size, out, max);
+		if (len < 0) {
+			LOGE("Corrupted lz4 block:%s", st->content->path);
+			goto end;
+		}
+		if (!sink(arg, out, len))
+			goto end;
+	}
+	/* content checksum, covered by the entry's own. */
+	if (hdr[4] & 0x04) {
+		uint8_t word[4];
+		if (!stream_read(st, word, 4))
+			goto end;
+	}
+	ret = true;
+end:
+	free(in);
+	free(out);
+	return ret;
+}
+
+#ifdef HAVE_ZSTD
+static bool zstd_decode(entry_stream *st, content_sink sink, void *arg)
+{
+	bool ret = false;
+	size_t out_size = ZSTD_DStreamOutSize();
+	void *out = malloc(out_size);
+	ZSTD_DStream *ds = ZSTD_createDStream();
+	size_t rc = 1;
+
+	if (!out || !ds)
+		goto end;
+	ZSTD_initDStream(ds);
+	while (st->pos < st->len || stream_fill(st)) {
+		ZSTD_inBuffer in = { st->buf + st->pos, st->len - st->pos, 0 };
+		while (in.pos < in.size) {
+			ZSTD_outBuffer o = { out, out_size, 0 };
+			rc = ZSTD_decompressStream(ds, &o, &in);
+			if (ZSTD_isError(rc)) {
+				LOGE("Corrupted zstd content:%s(%s)", st->content->path,
+				     ZSTD_getErrorName(rc));
+				goto end;
+			}
+			if (o.pos && !sink(arg, out, o.pos))
+				goto end;
+		}
+		st->pos = st->len;
+	}
+	if (rc) {
+		LOGE("Truncated content:%s", st->content->path);
+		goto end;
+	}
+	ret = true;
+end:
+	ZSTD_freeDStream(ds);
+	free(out);
+	return ret;
+}
+#endif
+
+/*
+ * Streams the content of an entry to sink, decompressing it on the way,
+ * and checks the stored content against its checksums.
+ */
+static bool read_content(resource_content *content, content_sink sink,
+                         void *arg)
+{
+	entry_stream *st = (entry_stream *)malloc(sizeof(*st));
+	bool ret = false;
+	if (!st)
+		return false;
+	stream_open(st, content);
+
+	switch (content->comp) {
+	case RESOURCE_COMP_NONE:
+		while (stream_fill(st)) {
+			if (!sink(arg, st->buf, st->len))
+				goto end;
+		}
+		ret = !st->left;
+		break;
+	case RESOURCE_COMP_LZ4:
+		ret = lz4_decode(st, sink, arg);
+		break;
+#ifdef HAVE_ZSTD
+	case RESOURCE_COMP_ZSTD:
+		ret = zstd_decode(st, sink, arg);
+		break;
+#endif
+	default:
+		LOGE("Unsupported compression(%d):%s", content->comp, content->path);
+		goto end;
+	}
+	/* the checksums cover all stored bytes, even after the frame. */
+	while (ret && stream_fill(st))
+		;
+	if (ret)
+		ret = csum_check(&st->csum, content);
+end:
+	free(st);
+	return ret;
+}
+
+static const char *comp_name(uint32_t comp)
+{
+	switch (comp) {
+	case RESOURCE_COMP_NONE:
+		return "none";
+	case RESOURCE_COMP_LZ4:
+		return "lz4";
+	case RESOURCE_COMP_ZSTD:
+		return "zstd";
+	}
+	return "unknown";
+}
+
+/**********************compress end************************/
 /**********************load test************************/
-static int load_file(const char *file_path, int offset_block, int blocks);
+static bool load_file(const char *file_path, int offset_block, int blocks);
 
 static int test_load(int argc, char **argv)
 {
@@ -246,7 +1063,7 @@ static int test_load(int argc, char **argv)
 	if (argc > 0) {
 		blocks = atoi(argv[0]);
 	}
-	return load_file(file_path, offset_block, blocks);
+	return load_file(file_path, offset_block, blocks) ? 0 : -1;
 }
 
 static void free_content(resource_content *content)
@@ -257,119 +1074,350 @@ static void free_content(resource_content *content)
 	}
 }
 
-static void tests_dump_file(const char *path, void *data, int len)
+typedef struct {
+	uint8_t *buf;
+	uint64_t len;
+	uint64_t cap;
+} mem_sink;
+
+static bool mem_sink_write(void *arg, const void *data, size_t len)
 {
-	FILE *file = fopen(path, "wb");
-	if (!file)
-		return;
-	fwrite(data, len, 1, file);
-	fclose(file);
+	mem_sink *mem = (mem_sink *)arg;
+	if (len > mem->cap - mem->len) {
+		LOGE("Content larger than its size!");
+		return false;
+	}
+	memcpy(mem->buf + mem->len, data, len);
+	mem->len += len;
+	return true;
 }
 
 static bool load_content(resource_content *content)
 {
 	if (content->load_addr)
 		return true;
-	int blocks = fix_blocks(content->content_size);
+	int blocks = fix_blocks(content->orig_size);
 	content->load_addr = malloc(blocks * BLOCK_SIZE);
 	if (!content->load_addr)
 		return false;
-	if (!StorageReadLba(get_ptn_offset() + content->content_offset,
-	                    content->load_addr, blocks)) {
+
+	mem_sink mem = { (uint8_t *)content->load_addr, 0, content->orig_size };
+	if (!read_content(content, mem_sink_write, &mem) ||
+	    mem.len != content->orig_size) {
+		LOGE("Failed to load content:%s", content->path);
 		free_content(content);
 		return false;
 	}
-
-	tests_dump_file(content->path, content->load_addr, content->content_size);
 	return true;
 }
 
-static bool load_content_data(resource_content *content, int offset_block,
-                              void *data, int blocks)
-{
-	if (!StorageReadLba(get_ptn_offset() + content->content_offset + offset_block,
-	                    data, blocks)) {
-		return false;
-	}
-	tests_dump_file(content->path, data, blocks * BLOCK_SIZE);
-	return true;
-}
 
-static bool get_entry(const char *file_path, index_tbl_entry *entry)
+/*
+ * Reads and checks the partition header. The v1 fields of a v0 header are
+ * filled in from the v0 ones, so callers handle both versions alike.
+ */
+static bool read_ptn_header(resource_ptn_header_v1 *hdr)
 {
-	bool ret = false;
 	char buf[BLOCK_SIZE];
-	resource_ptn_header header;
 	if (!StorageReadLba(get_ptn_offset(), buf, 1)) {
 		LOGE("Failed to read header!");
-		goto end;
+		return false;
 	}
-	memcpy(&header, buf, sizeof(header));
+	memcpy(hdr, buf, sizeof(*hdr));
 
-	if (memcmp(header.magic, RESOURCE_PTN_HDR_MAGIC, sizeof(header.magic))) {
+	if (memcmp(hdr->magic, RESOURCE_PTN_HDR_MAGIC, sizeof(hdr->magic))) {
 		LOGE("Not a resource image(%s)!", image_path);
-		goto end;
+		return false;
 	}
 	/* test on pc, switch for be. */
-	fix_header(&header);
+	fix_header(hdr);
+
+	if (hdr->resource_ptn_version == RESOURCE_PTN_VERSION) {
+		/* TODO: support header_size & tbl_entry_size */
+		if (hdr->header_size != RESOURCE_PTN_HDR_SIZE ||
+		    hdr->index_tbl_version != INDEX_TBL_VERSION ||
+		    hdr->tbl_entry_size != INDEX_TBL_ENTR_SIZE)
+			goto unsupported;
+		hdr->entry_size = hdr->tbl_entry_size * BLOCK_SIZE;
+		hdr->align = BLOCK_SIZE;
+		hdr->flags = 0;
+		hdr->tbl_size = hdr->tbl_entry_num * hdr->entry_size;
+		hdr->tbl_offset_v1 = hdr->tbl_offset * BLOCK_SIZE;
+		hdr->tbl_crc = 0;
+		return true;
+	}
 
-	/* TODO: support header_size & tbl_entry_size */
-	if (header.resource_ptn_version != RESOURCE_PTN_VERSION ||
-	    header.header_size != RESOURCE_PTN_HDR_SIZE ||
-	    header.index_tbl_version != INDEX_TBL_VERSION ||
-	    header.tbl_entry_size != INDEX_TBL_ENTR_SIZE) {
-		LOGE("Not supported in this version!");
-		goto end;
+	if (hdr->resource_ptn_version == RESOURCE_PTN_VERSION_V1 &&
+	    hdr->index_tbl_version == INDEX_TBL_VERSION_V1 &&
+	    hdr->entry_size >= sizeof(index_tbl_entry_v1) &&
+	    hdr->tbl_size / hdr->entry_size >= hdr->tbl_entry_num &&
+	    !(hdr->tbl_offset_v1 % BLOCK_SIZE))
+		return true;
+
+unsupported:
+	LOGE("Not supported in this version!");
+	return false;
+}
+
+/* returns: the whole index table, read at once, NULL on error. */
+static void *read_index_tbl(resource_ptn_header_v1 *hdr)
+{
+	int blocks = fix_blocks(hdr->tbl_size);
+	void *tbl = malloc((blocks + 1) * BLOCK_SIZE);
+	if (!tbl)
+		return NULL;
+	if (blocks && !StorageReadLba(get_ptn_offset() +
+	                              hdr->tbl_offset_v1 / BLOCK_SIZE,
+	                              tbl, blocks)) {
+		LOGE("Failed to read index table!");
+		goto err;
 	}
+	if (hdr->resource_ptn_version == RESOURCE_PTN_VERSION_V1 &&
+	    crc32_update(0, tbl, hdr->tbl_size) != hdr->tbl_crc) {
+		LOGE("Index table corrupted!");
+		goto err;
+	}
+	return tbl;
+err:
+	free(tbl);
+	return NULL;
+}
 
-	int i;
-	for (i = 0; i < header.tbl_entry_num; i++) {
-		/* TODO: support tbl_entry_size */
-		if (!StorageReadLba(
-		            get_ptn_offset() + header.header_size + i * header.tbl_entry_size,
-		            buf, 1)) {
-			LOGE("Failed to read index entry:%d!", i);
-			goto end;
-		}
-		memcpy(entry, buf, sizeof(*entry));
+/* header and index table of the image, read once while it is cached. */
+static bool image_index(resource_ptn_header_v1 **hdr, void **tbl)
+{
+	if (!image_open()) {
+		LOGE("Failed to open:%s", image_path);
+		return false;
+	}
+	if (!image_cache.has_index) {
+		if (!read_ptn_header(&image_cache.hdr))
+			return false;
+		image_cache.tbl = read_index_tbl(&image_cache.hdr);
+		if (!image_cache.tbl)
+			return false;
+		image_cache.has_index = true;
+	}
+	*hdr = &image_cache.hdr;
+	*tbl = image_cache.tbl;
+	return true;
+}
+
+static uint32_t get_index_hash(resource_ptn_header_v1 *hdr, void *tbl, int i)
+{
+	index_tbl_entry_v1 entry;
+	memcpy(&entry, (char *)tbl + i * hdr->entry_size, sizeof(entry));
+	return switch_int(entry.path_hash);
+}
+
+/* fills content from entry i of the index table. */
+static bool get_index_entry(resource_ptn_header_v1 *hdr, void *tbl, int i,
+                            resource_content *content)
+{
+	char *p = (char *)tbl + i * hdr->entry_size;
 
-		if (memcmp(entry->tag, INDEX_TBL_ENTR_TAG, sizeof(entry->tag))) {
+	if (hdr->resource_ptn_version == RESOURCE_PTN_VERSION) {
+		index_tbl_entry entry;
+		memcpy(&entry, p, sizeof(entry));
+		if (memcmp(entry.tag, INDEX_TBL_ENTR_TAG, sizeof(entry.tag))) {
 			LOGE("Something wrong with index entry:%d!", i);
-			goto end;
+			return false;
 		}
-
-		if (!strncmp(entry->path, file_path, sizeof(entry->path)))
-			break;
-	}
-	if (i == header.tbl_entry_num) {
-		LOGE("Cannot find %s!", file_path);
-		goto end;
+		/* test on pc, switch for be. */
+		fix_entry(&entry);
+		snprintf(content->path, sizeof(content->path), "%.*s",
+		         (int)sizeof(entry.path), entry.path);
+		content->content_offset = entry.content_offset;
+		content->content_size = entry.content_size;
+		content->orig_size = entry.content_size;
+		content->comp = RESOURCE_COMP_NONE;
+		content->flags = 0;
+		return true;
 	}
+
+	index_tbl_entry_v1 entry;
+	memcpy(&entry, p, sizeof(entry));
 	/* test on pc, switch for be. */
-	fix_entry(entry);
+	fix_entry_v1(&entry);
+	if (entry.path_offset >= hdr->tbl_size ||
+	    !memchr((char *)tbl + entry.path_offset, '\0',
+	            hdr->tbl_size - entry.path_offset) ||
+	    entry.content_offset % BLOCK_SIZE) {
+		LOGE("Something wrong with index entry:%d!", i);
+		return false;
+	}
+	snprintf(content->path, sizeof(content->path), "%s",
+	         (char *)tbl + entry.path_offset);
+	content->content_offset = entry.content_offset / BLOCK_SIZE;
+	content->content_size = entry.content_size;
+	content->orig_size = entry.orig_size;
+	content->comp = entry.flags & RESOURCE_COMP_MASK;
+	content->flags = hdr->flags;
+	content->crc32 = entry.crc32;
+	memcpy(content->sha256, entry.sha256, sizeof(content->sha256));
+	return true;
+}
 
-	printf("Found entry:\n\tpath:%s\n\toffset:%d\tsize:%d\n", entry->path,
-	       entry->content_offset, entry->content_size);
+/*
+ * Looks up content->path: binary search on the path hash for v1 images,
+ * linear scan for v0.
+ */
+static bool find_content(resource_content *content)
+{
+	bool ret = false;
+	bool found = false;
+	resource_ptn_header_v1 *hdr;
+	char path[MAX_INDEX_ENTRY_PATH_LEN];
+	void *tbl;
+	int num, i;
+
+	snprintf(path, sizeof(path), "%s", content->path);
+	if (!image_index(&hdr, &tbl))
+		goto end;
 
+	num = hdr->tbl_entry_num;
+	i = 0;
+	if (hdr->resource_ptn_version == RESOURCE_PTN_VERSION_V1) {
+		uint32_t hash = path_hash(path);
+		int hi = num;
+		while (i < hi) {
+			int mid = i + (hi - i) / 2;
+			if (get_index_hash(hdr, tbl, mid) < hash)
+				i = mid + 1;
+			else
+				hi = mid;
+		}
+		for (; i < num && get_index_hash(hdr, tbl, i) == hash; i++) {
+			if (!get_index_entry(hdr, tbl, i, content))
+				goto end;
+			if (!strcmp(content->path, path)) {
+				found = true;
+				break;
+			}
+		}
+	} else {
+		for (; i < num; i++) {
+			if (!get_index_entry(hdr, tbl, i, content))
+				goto end;
+			if (!strcmp(content->path, path)) {
+				found = true;
+				break;
+			}
+		}
+	}
+	if (!found) {
+		LOGE("Cannot find %s!", path);
+		goto end;
+	}
 	ret = true;
 end:
+	if (!ret)
+		snprintf(content->path, sizeof(content->path), "%s", path);
 	return ret;
 }
 
 static bool get_content(resource_content *content)
 {
-	bool ret = false;
-	index_tbl_entry entry;
-	if (!get_entry(content->path, &entry))
-		goto end;
-	content->content_offset = entry.content_offset;
-	content->content_size = entry.content_size;
-	ret = true;
-end:
-	return ret;
+	if (!find_content(content))
+		return false;
+
+	printf("Found entry:\n\tpath:%s\n\toffset:%llu\tsize:%llu\n", content->path,
+	       (unsigned long long)content->content_offset,
+	       (unsigned long long)content->content_size);
+	return true;
+}
+
+/*
+ * Ranged reads of resource entries, for tools that only need a few bytes of
+ * each (DTB headers, BMP dimensions): only the blocks covering the range are
+ * read, nothing is dumped, and all lookups share the cached image. Ranges
+ * of compressed entries are decoded from the start of the content.
+ */
+static bool resource_open(const char *path, resource_content *content)
+{
+	memset(content, 0, sizeof(*content));
+	snprintf(content->path, sizeof(content->path), "%s", path);
+	return find_content(content);
+}
+
+static void resource_close(resource_content *content)
+{
+	free_content(content);
 }
 
-static int load_file(const char *file_path, int offset_block, int blocks)
+typedef struct {
+	uint64_t skip; /* bytes before the range. */
+	uint8_t *buf;
+	size_t len;    /* bytes still wanted. */
+} range_sink;
+
+/* returns false to stop decoding once the range is complete. */
+static bool range_sink_write(void *arg, const void *data, size_t len)
+{
+	range_sink *range = (range_sink *)arg;
+	const uint8_t *p = (const uint8_t *)data;
+	size_t n;
+
+	if (range->skip >= len) {
+		range->skip -= len;
+		return true;
+	}
+	p += range->skip;
+	len -= range->skip;
+	range->skip = 0;
+	n = len < range->len ? len : range->len;
+	memcpy(range->buf, p, n);
+	range->buf += n;
+	range->len -= n;
+	return range->len > 0;
+}
+
+/* returns: bytes read, less than len at the end of the content, -1 on error */
+static int resource_read(resource_content *content, uint64_t offset,
+                         void *buf, int len)
+{
+	uint8_t chunk[STREAM_CHUNK_BLOCKS * BLOCK_SIZE];
+	uint8_t *p = (uint8_t *)buf;
+	int left;
+
+	if (len < 0)
+		return -1;
+	if (offset >= content->orig_size)
+		return 0;
+	if (len > content->orig_size - offset)
+		len = content->orig_size - offset;
+
+	if (content->comp != RESOURCE_COMP_NONE) {
+		range_sink range = { offset, p, len };
+		read_content(content, range_sink_write, &range);
+		return range.len ? -1 : len;
+	}
+
+	for (left = len; left > 0;) {
+		uint64_t block = offset / BLOCK_SIZE;
+		int skip = offset % BLOCK_SIZE;
+		int blocks = fix_blocks(skip + left);
+		int n;
+		if (blocks > STREAM_CHUNK_BLOCKS)
+			blocks = STREAM_CHUNK_BLOCKS;
+		if (!StorageReadLba(get_ptn_offset() + content->content_offset + block,
+		                    chunk, blocks)) {
+			LOGE("Failed to read content:%s", content->path);
+			return -1;
+		}
+		n = blocks * BLOCK_SIZE - skip;
+		if (n > left)
+			n = left;
+		memcpy(p, chunk + skip, n);
+		p += n;
+		offset += n;
+		left -= n;
+	}
+	return len;
+}
+
+/* loads an entry (or a block range of it) and checks it, nothing is dumped. */
+static bool load_file(const char *file_path, int offset_block, int blocks)
 {
 	printf("Try to load:%s", file_path);
 	if (blocks) {
@@ -379,11 +1427,12 @@ static int load_file(const char *file_path, int offset_block, int blocks)
 	}
 	bool ret = false;
 	resource_content content;
-	snprintf(content.path, sizeof(content.path), "%s", file_path);
-	content.load_addr = 0;
-	if (!get_content(&content)) {
+	if (!resource_open(file_path, &content)) {
 		goto end;
 	}
+	printf("Found entry:\n\tpath:%s\n\toffset:%llu\tsize:%llu\n", content.path,
+	       (unsigned long long)content.content_offset,
+	       (unsigned long long)content.content_size);
 	if (!blocks) {
 		if (!load_content(&content)) {
 			goto end;
@@ -392,16 +1441,66 @@ static int load_file(const char *file_path, int offset_block, int blocks)
 		void *data = malloc(blocks * BLOCK_SIZE);
 		if (!data)
 			goto end;
-		if (!load_content_data(&content, offset_block, data, blocks)) {
+		int len = resource_read(&content, (uint64_t)offset_block * BLOCK_SIZE,
+		                        data, blocks * BLOCK_SIZE);
+		free(data);
+		if (len < 0)
 			goto end;
-		}
+		printf("Read %d bytes\n", len);
 	}
 	ret = true;
 end:
-	free_content(&content);
+	resource_close(&content);
 	return ret;
 }
 
+/* --read=path:offset:len, writes a byte range of an entry to stdout. */
+static int read_range(const char *spec)
+{
+	char path[MAX_INDEX_ENTRY_PATH_LEN];
+	char *sep;
+	uint64_t offset;
+	int len;
+	void *data = NULL;
+	bool ret = false;
+	resource_content content;
+
+	memset(&content, 0, sizeof(content));
+	snprintf(path, sizeof(path), "%s", spec);
+	/* the path itself may contain ':', so parse from the end. */
+	sep = strrchr(path, ':');
+	if (!sep)
+		goto bad;
+	len = atoi(sep + 1);
+	*sep = '\0';
+	sep = strrchr(path, ':');
+	if (!sep || len <= 0)
+		goto bad;
+	offset = strtoull(sep + 1, NULL, 0);
+	*sep = '\0';
+
+	if (!resource_open(fix_path(path), &content))
+		goto end;
+	data = malloc(len);
+	if (!data)
+		goto end;
+	len = resource_read(&content, offset, data, len);
+	if (len < 0)
+		goto end;
+	if (len && fwrite(data, len, 1, stdout) != 1) {
+		LOGE("Failed to write:%s", path);
+		goto end;
+	}
+	ret = true;
+	goto end;
+bad:
+	LOGE("Bad range, expect path:offset:len:%s", spec);
+end:
+	free(data);
+	resource_close(&content);
+	return ret ? 0 : -1;
+}
+
 /**********************load test end************************/
 /**********************anim test************************/
 
@@ -445,28 +1544,12 @@ static bool parse_level_conf(const char *arg, anim_level_conf *level_conf)
 	return true;
 }
 
-static int test_charge(int argc, char **argv)
+/*
+ * Parses a charge anim desc, buf is split into lines in place and must be
+ * terminated at end.
+ */
+static bool parse_charge_desc(char *buf, char *end, anim_desc *desc)
 {
-	const char *desc;
-	if (argc > 0) {
-		desc = argv[0];
-	} else {
-		desc = DEF_CHARGE_DESC_PATH;
-	}
-
-	resource_content content;
-	snprintf(content.path, sizeof(content.path), "%s", desc);
-	content.load_addr = 0;
-	if (!get_content(&content)) {
-		goto end;
-	}
-	if (!load_content(&content)) {
-		goto end;
-	}
-
-	char *buf = (char *)content.load_addr;
-	char *end = buf + content.content_size - 1;
-	*end = '\0';
 	LOGD("desc:\n%s", buf);
 
 	int pos = 0;
@@ -527,6 +1610,8 @@ static int test_charge(int argc, char **argv)
 			}
 			level_confs =
 			        (anim_level_conf *)malloc(level_conf_num * sizeof(anim_level_conf));
+			if (!level_confs)
+				goto end;
 			LOGD("Found levels:%d", level_conf_num);
 		} else {
 			LOGE("Unknown arg:%s", arg);
@@ -562,14 +1647,132 @@ static int test_charge(int argc, char **argv)
 		}
 	}
 
-	printf("Parse anim desc(%s):\n", desc);
-	printf("only_current_level=%d\n", only_current_level);
-	printf("level conf:\n");
-	for (i = 0; i < level_conf_num; i++) {
-		printf("\tmax=%d, delay=%d, num=%d, prefix=%s\n", level_confs[i].max_level,
-		       level_confs[i].delay, level_confs[i].num, level_confs[i].prefix);
+	desc->delay = delay;
+	desc->only_current_level = only_current_level;
+	desc->level_num = level_conf_num;
+	desc->levels = level_confs;
+	return true;
+end:
+	if (level_confs)
+		free(level_confs);
+	return false;
+}
+
+static void print_charge_desc(const char *desc_path, anim_desc *desc)
+{
+	int i;
+
+	printf("Parse anim desc(%s):\n", desc_path);
+	printf("only_current_level=%d\n", desc->only_current_level);
+	printf("level conf:\n");
+	for (i = 0; i < desc->level_num; i++) {
+		printf("\tmax=%d, delay=%d, num=%d, prefix=%s\n",
+		       desc->levels[i].max_level, desc->levels[i].delay,
+		       desc->levels[i].num, desc->levels[i].prefix);
+	}
+}
+
+/*
+ * Checks the compiled descriptor the way the bootloader uses it: one read
+ * for the table, then one read per level for the whole atlas.
+ */
+static bool test_charge_bin(void)
+{
+	bool ret = false;
+	resource_content content;
+	resource_content atlas;
+	snprintf(content.path, sizeof(content.path), "%s", CHARGE_DESC_BIN_PATH);
+	content.load_addr = 0;
+	atlas.load_addr = 0;
+	if (!get_content(&content) || !load_content(&content))
+		goto end;
+
+	charge_desc_bin *hdr = (charge_desc_bin *)content.load_addr;
+	if (content.orig_size < sizeof(*hdr) ||
+	    memcmp(hdr->magic, CHARGE_DESC_BIN_MAGIC, sizeof(hdr->magic)) ||
+	    switch_int(hdr->version) != CHARGE_DESC_BIN_VERSION) {
+		LOGE("Bad compiled anim desc!");
+		goto end;
+	}
+	int level_num = switch_int(hdr->level_num);
+	charge_level_bin *levels = (charge_level_bin *)(hdr + 1);
+	if (content.orig_size < sizeof(*hdr) + level_num * sizeof(*levels)) {
+		LOGE("Bad compiled anim desc!");
+		goto end;
+	}
+
+	printf("Compiled anim desc(%s):\n", CHARGE_DESC_BIN_PATH);
+	printf("only_current_level=%d\n", switch_int(hdr->only_current_level));
+	printf("level conf:\n");
+	int i, j;
+	for (i = 0; i < level_num; i++) {
+		int num = switch_int(levels[i].num);
+		printf("\tmax=%d, delay=%d, num=%d\n", switch_int(levels[i].max_level),
+		       switch_int(levels[i].delay), num);
+
+		snprintf(atlas.path, sizeof(atlas.path), CHARGE_ATLAS_PATH, i);
+		if (!get_content(&atlas) || !load_content(&atlas))
+			goto end;
+		charge_atlas_header *ahdr = (charge_atlas_header *)atlas.load_addr;
+		charge_atlas_frame *frames = (charge_atlas_frame *)(ahdr + 1);
+		/* the header and the whole frame table must lie inside the atlas */
+		if (atlas.orig_size < sizeof(*ahdr) ||
+		    memcmp(ahdr->magic, CHARGE_ATLAS_MAGIC, sizeof(ahdr->magic)) ||
+		    switch_int(ahdr->frame_num) != num ||
+		    sizeof(*ahdr) + (uint64_t)(uint32_t)num * sizeof(*frames) >
+			    atlas.orig_size) {
+			LOGE("Bad atlas:%s", atlas.path);
+			goto end;
+		}
+		for (j = 0; j < num; j++) {
+			uint32_t offset = switch_int(frames[j].offset);
+			uint32_t size = switch_int(frames[j].size);
+			if ((uint64_t)offset + size > atlas.orig_size) {
+				LOGE("Bad frame %d in atlas:%s", j, atlas.path);
+				goto end;
+			}
+			printf("\t\tframe %d: offset=%u, size=%u\n", j, offset, size);
+		}
+		free_content(&atlas);
+	}
+	ret = true;
+end:
+	free_content(&atlas);
+	free_content(&content);
+	return ret;
+}
+
+static int test_charge(int argc, char **argv)
+{
+	const char *desc;
+	if (argc > 0) {
+		desc = argv[0];
+	} else {
+		desc = DEF_CHARGE_DESC_PATH;
+		if (test_charge_bin())
+			return 0;
+	}
+
+	resource_content content;
+	snprintf(content.path, sizeof(content.path), "%s", desc);
+	content.load_addr = 0;
+	if (!get_content(&content)) {
+		goto end;
+	}
+	if (!load_content(&content)) {
+		goto end;
 	}
 
+	char *buf = (char *)content.load_addr;
+	char *end = buf + content.orig_size - 1;
+	*end = '\0';
+
+	anim_desc anim;
+	if (!parse_charge_desc(buf, end, &anim))
+		goto end;
+	print_charge_desc(desc, &anim);
+	free(anim.levels);
+
 end:
 	free_content(&content);
 	return 0;
@@ -579,9 +1782,14 @@ end:
 /**********************append file************************/
 
 static const char *PROG = NULL;
-static resource_ptn_header header;
+static resource_ptn_header_v1 header;
 static bool just_print = false;
 static char root_path[MAX_INDEX_ENTRY_PATH_LEN] = "\0";
+static int pack_version = RESOURCE_PTN_VERSION;
+static uint32_t pack_align = BLOCK_SIZE;
+static uint32_t pack_flags = RESOURCE_FLAG_CRC32;
+static uint32_t pack_comp = RESOURCE_COMP_NONE;
+static resource_content *pack_entries = NULL;
 
 static void version(void)
 {
@@ -599,11 +1807,24 @@ static void usage(void)
 	printf("\t" OPT_IMAGE "path"
 	       "\t\tSpecify input/output image path.\n");
 	printf("\t" OPT_PRINT "\t\t\tJust print informations.\n");
+	printf("\t" OPT_READ "path:offset:len"
+	       "\tWrite a byte range of an entry to stdout.\n");
 	printf("\t" OPT_VERBOSE "\t\tDisplay more runtime informations.\n");
 	printf("\t" OPT_HELP "\t\t\tDisplay this information.\n");
 	printf("\t" OPT_VERSION "\t\tDisplay version information.\n");
 	printf("\t" OPT_ROOT "path"
 	       "\t\tSpecify resources' root dir.\n");
+	printf("\t" OPT_FORMAT "0|1"
+	       "\t\tImage version to pack, default 0.\n");
+	printf("\t" OPT_ALIGN "bytes"
+	       "\t\tAlignment of contents (v1), default %d.\n", BLOCK_SIZE);
+	printf("\t" OPT_CHECKSUM "none|crc32|sha256"
+	       "\tChecksums of contents (v1), default crc32.\n");
+	printf("\t" OPT_COMPRESS "none|lz4"
+#ifdef HAVE_ZSTD
+	       "|zstd"
+#endif
+	       "\tCompression of contents (v1), default none.\n");
 }
 
 static int pack_image(int file_num, const char **files);
@@ -614,6 +1835,7 @@ enum ACTION {
 	ACTION_UNPACK,
 	ACTION_TEST_LOAD,
 	ACTION_TEST_CHARGE,
+	ACTION_READ,
 };
 
 int main(int argc, char **argv)
@@ -621,6 +1843,7 @@ int main(int argc, char **argv)
 	PROG = fix_path(argv[0]);
 
 	enum ACTION action = ACTION_PACK;
+	const char *read_spec = NULL;
 
 	argc--, argv++;
 	while (argc > 0 && argv[0][0] == '-') {
@@ -645,10 +1868,52 @@ int main(int argc, char **argv)
 			action = ACTION_TEST_LOAD;
 		} else if (!strcmp(OPT_TEST_CHARGE, arg)) {
 			action = ACTION_TEST_CHARGE;
+		} else if (!memcmp(OPT_READ, arg, strlen(OPT_READ))) {
+			action = ACTION_READ;
+			read_spec = arg + strlen(OPT_READ);
 		} else if (!memcmp(OPT_IMAGE, arg, strlen(OPT_IMAGE))) {
 			snprintf(image_path, sizeof(image_path), "%s", arg + strlen(OPT_IMAGE));
 		} else if (!memcmp(OPT_ROOT, arg, strlen(OPT_ROOT))) {
 			snprintf(root_path, sizeof(root_path), "%s", arg + strlen(OPT_ROOT));
+		} else if (!memcmp(OPT_FORMAT, arg, strlen(OPT_FORMAT))) {
+			pack_version = atoi(arg + strlen(OPT_FORMAT));
+			if (pack_version != RESOURCE_PTN_VERSION &&
+			    pack_version != RESOURCE_PTN_VERSION_V1) {
+				LOGE("Unknown format:%s", arg);
+				return -1;
+			}
+		} else if (!memcmp(OPT_ALIGN, arg, strlen(OPT_ALIGN))) {
+			pack_align = atoi(arg + strlen(OPT_ALIGN));
+			if (!pack_align || pack_align % BLOCK_SIZE) {
+				LOGE("Alignment must be a multiple of %d:%s", BLOCK_SIZE, arg);
+				return -1;
+			}
+		} else if (!memcmp(OPT_CHECKSUM, arg, strlen(OPT_CHECKSUM))) {
+			const char *type = arg + strlen(OPT_CHECKSUM);
+			if (!strcmp(type, "none")) {
+				pack_flags = 0;
+			} else if (!strcmp(type, "crc32")) {
+				pack_flags = RESOURCE_FLAG_CRC32;
+			} else if (!strcmp(type, "sha256")) {
+				pack_flags = RESOURCE_FLAG_CRC32 | RESOURCE_FLAG_SHA256;
+			} else {
+				LOGE("Unknown checksum:%s", arg);
+				return -1;
+			}
+		} else if (!memcmp(OPT_COMPRESS, arg, strlen(OPT_COMPRESS))) {
+			const char *type = arg + strlen(OPT_COMPRESS);
+			if (!strcmp(type, "none")) {
+				pack_comp = RESOURCE_COMP_NONE;
+			} else if (!strcmp(type, "lz4")) {
+				pack_comp = RESOURCE_COMP_LZ4;
+#ifdef HAVE_ZSTD
+			} else if (!strcmp(type, "zstd")) {
+				pack_comp = RESOURCE_COMP_ZSTD;
+#endif
+			} else {
+				LOGE("Unknown compression:%s", arg);
+				return -1;
+			}
 		} else {
 			LOGE("Unknown opt:%s", arg);
 			usage();
@@ -680,6 +1945,9 @@ int main(int argc, char **argv)
 	case ACTION_TEST_CHARGE: {
 		return test_charge(argc, argv);
 	}
+	case ACTION_READ: {
+		return read_range(read_spec);
+	}
 	}
 	/* not reach here. */
 	return -1;
@@ -706,20 +1974,22 @@ static bool mkdirs(char *path)
 	return ret;
 }
 
-static bool dump_file(FILE *file, const char *unpack_dir,
-                      index_tbl_entry entry)
+static bool file_sink_write(void *arg, const void *data, size_t len)
+{
+	return fwrite(data, len, 1, (FILE *)arg) == 1 || !len;
+}
+
+static bool dump_file(const char *unpack_dir, resource_content entry)
 {
 	LOGD("try to dump entry:%s", entry.path);
 	bool ret = false;
 	FILE *out_file = NULL;
-	long int pos = 0;
 	char path[MAX_INDEX_ENTRY_PATH_LEN * 2 + 1];
 	if (just_print) {
 		ret = true;
-		goto done;
+		goto end;
 	}
 
-	pos = ftell(file);
 	snprintf(path, sizeof(path), "%s/%s", unpack_dir, entry.path);
 	mkdirs(path);
 	out_file = fopen(path, "wb");
@@ -727,40 +1997,20 @@ static bool dump_file(FILE *file, const char *unpack_dir,
 		LOGE("Failed to create:%s", path);
 		goto end;
 	}
-	long int offset = entry.content_offset * BLOCK_SIZE;
-	fseek(file, offset, SEEK_SET);
-	if (offset != ftell(file)) {
-		LOGE("Failed to read content:%s", entry.path);
+	if (!read_content(&entry, file_sink_write, out_file)) {
+		LOGE("Failed to dump:%s", entry.path);
 		goto end;
 	}
-	char buf[BLOCK_SIZE];
-	int n;
-	int len = entry.content_size;
-	while (len > 0) {
-		n = len > BLOCK_SIZE ? BLOCK_SIZE : len;
-		if (!fread(buf, n, 1, file)) {
-			LOGE("Failed to read content:%s", entry.path);
-			goto end;
-		}
-		if (!fwrite(buf, n, 1, out_file)) {
-			LOGE("Failed to write:%s", entry.path);
-			goto end;
-		}
-		len -= n;
-	}
-done:
 	ret = true;
 end:
 	if (out_file)
 		fclose(out_file);
-	if (pos)
-		fseek(file, pos, SEEK_SET);
 	return ret;
 }
 
 static int unpack_image(const char *dir)
 {
-	FILE *image_file = NULL;
+	void *tbl = NULL;
 	bool ret = false;
 	char unpack_dir[MAX_INDEX_ENTRY_PATH_LEN];
 	if (just_print)
@@ -773,70 +2023,51 @@ static int unpack_image(const char *dir)
 	}
 
 	mkdir(unpack_dir, 0755);
-	image_file = fopen(image_path, "rb");
-	char buf[BLOCK_SIZE];
-	if (!image_file) {
-		LOGE("Failed to open:%s", image_path);
+	resource_ptn_header_v1 *hdr;
+	if (!image_index(&hdr, &tbl))
 		goto end;
-	}
-	if (!fread(buf, BLOCK_SIZE, 1, image_file)) {
-		LOGE("Failed to read header!");
-		goto end;
-	}
-	memcpy(&header, buf, sizeof(header));
-
-	if (memcmp(header.magic, RESOURCE_PTN_HDR_MAGIC, sizeof(header.magic))) {
-		LOGE("Not a resource image(%s)!", image_path);
-		goto end;
-	}
-	/* switch for be. */
-	fix_header(&header);
+	header = *hdr;
 
 	printf("Dump header:\n");
 	printf("partition version:%d.%d\n", header.resource_ptn_version,
 	       header.index_tbl_version);
 	printf("header size:%d\n", header.header_size);
-	printf("index tbl:\n\toffset:%d\tentry size:%d\tentry num:%d\n",
-	       header.tbl_offset, header.tbl_entry_size, header.tbl_entry_num);
-
-	/* TODO: support header_size & tbl_entry_size */
-	if (header.resource_ptn_version != RESOURCE_PTN_VERSION ||
-	    header.header_size != RESOURCE_PTN_HDR_SIZE ||
-	    header.index_tbl_version != INDEX_TBL_VERSION ||
-	    header.tbl_entry_size != INDEX_TBL_ENTR_SIZE) {
-		LOGE("Not supported in this version!");
-		goto end;
-	}
+	printf("index tbl:\n\toffset:%llu\tentry size:%d\tentry num:%d\n",
+	       (unsigned long long)header.tbl_offset_v1, header.entry_size,
+	       header.tbl_entry_num);
+	if (header.resource_ptn_version == RESOURCE_PTN_VERSION_V1)
+		printf("\tsize:%d\talign:%d\tchecksums:%s%s\n", header.tbl_size,
+		       header.align,
+		       header.flags & RESOURCE_FLAG_CRC32 ? " crc32" : "",
+		       header.flags & RESOURCE_FLAG_SHA256 ? " sha256" : "");
 
 	printf("Dump Index table:\n");
-	index_tbl_entry entry;
+	resource_content entry;
 	int i;
 	for (i = 0; i < header.tbl_entry_num; i++) {
-		/* TODO: support tbl_entry_size */
-		if (!fread(buf, BLOCK_SIZE, 1, image_file)) {
-			LOGE("Failed to read index entry:%d!", i);
+		if (!get_index_entry(&header, tbl, i, &entry))
 			goto end;
-		}
-		memcpy(&entry, buf, sizeof(entry));
 
-		if (memcmp(entry.tag, INDEX_TBL_ENTR_TAG, sizeof(entry.tag))) {
-			LOGE("Something wrong with index entry:%d!", i);
-			goto end;
+		printf("entry(%d):\n\tpath:%s\n\toffset:%llu\tsize:%llu\n", i,
+		       entry.path, (unsigned long long)entry.content_offset,
+		       (unsigned long long)entry.orig_size);
+		if (entry.comp != RESOURCE_COMP_NONE)
+			printf("\t%s:%llu\n", comp_name(entry.comp),
+			       (unsigned long long)entry.content_size);
+		if (entry.flags & RESOURCE_FLAG_SHA256) {
+			int j;
+			printf("\tsha256:");
+			for (j = 0; j < SHA256_DIGEST_SIZE; j++)
+				printf("%02x", entry.sha256[j]);
+			printf("\n");
 		}
-		/* switch for be. */
-		fix_entry(&entry);
-
-		printf("entry(%d):\n\tpath:%s\n\toffset:%d\tsize:%d\n", i, entry.path,
-		       entry.content_offset, entry.content_size);
-		if (!dump_file(image_file, unpack_dir, entry)) {
+		if (!dump_file(unpack_dir, entry)) {
 			goto end;
 		}
 	}
 	printf("Unack %s to %s successed!\n", image_path, unpack_dir);
 	ret = true;
 end:
-	if (image_file)
-		fclose(image_file);
 	return ret ? 0 : -1;
 }
 
@@ -855,9 +2086,10 @@ static inline size_t get_file_size(const char *path)
 	return st.st_size;
 }
 
-static int write_file(int offset_block, const char *src_path)
+static int write_file(uint64_t offset_block, const char *src_path)
 {
-	LOGD("try to write file(%s) to offset:%d...", src_path, offset_block);
+	LOGD("try to write file(%s) to offset:%llu...", src_path,
+	     (unsigned long long)offset_block);
 	char buf[BLOCK_SIZE];
 	int ret = -1;
 	size_t file_size;
@@ -892,57 +2124,604 @@ end:
 	return ret;
 }
 
-static bool write_header(const int file_num)
+/* sets up the header of the image to pack, see write_header(). */
+static void init_header(const int entry_num)
 {
-	LOGD("try to write header...");
+	memset(&header, 0, sizeof(header));
 	memcpy(header.magic, RESOURCE_PTN_HDR_MAGIC, sizeof(header.magic));
-	header.resource_ptn_version = RESOURCE_PTN_VERSION;
-	header.index_tbl_version = INDEX_TBL_VERSION;
 	header.header_size = RESOURCE_PTN_HDR_SIZE;
-	header.tbl_offset = header.header_size;
-	header.tbl_entry_size = INDEX_TBL_ENTR_SIZE;
-	header.tbl_entry_num = file_num;
+	header.tbl_entry_num = entry_num;
+	if (pack_version == RESOURCE_PTN_VERSION) {
+		header.resource_ptn_version = RESOURCE_PTN_VERSION;
+		header.index_tbl_version = INDEX_TBL_VERSION;
+		header.tbl_offset = header.header_size;
+		header.tbl_entry_size = INDEX_TBL_ENTR_SIZE;
+		header.entry_size = header.tbl_entry_size * BLOCK_SIZE;
+		header.align = BLOCK_SIZE;
+	} else {
+		header.resource_ptn_version = RESOURCE_PTN_VERSION_V1;
+		header.index_tbl_version = INDEX_TBL_VERSION_V1;
+		header.entry_size = sizeof(index_tbl_entry_v1);
+		header.align = pack_align;
+		header.flags = pack_flags;
+	}
+}
+
+/* written last: the v1 fields describe the index table. */
+static bool write_header(void)
+{
+	LOGD("try to write header...");
 
 	/* switch for le. */
-	resource_ptn_header hdr = header;
+	resource_ptn_header_v1 hdr = header;
 	fix_header(&hdr);
+	if (header.resource_ptn_version == RESOURCE_PTN_VERSION)
+		return write_data(0, &hdr, sizeof(resource_ptn_header));
 	return write_data(0, &hdr, sizeof(hdr));
 }
 
+/* offset_block rounded up to the content alignment. */
+static uint64_t align_blocks(uint64_t offset_block)
+{
+	uint64_t align = header.align / BLOCK_SIZE;
+	return (offset_block + align - 1) / align * align;
+}
+
+/* entry path of a packed file: relative to root_path, without "./" */
+static const char *get_entry_path(const char *file)
+{
+	const char *path = file;
+	if (root_path[0]) {
+		if (!strncmp(path, root_path, strlen(root_path))) {
+			path += strlen(root_path);
+			if (path[0] == '/')
+				path++;
+		}
+	}
+	return fix_path(path);
+}
+
+/* entries are collected here and written by write_index_v0/v1(). */
+static bool write_entry(int index, const char *path, uint64_t offset,
+                        uint64_t size)
+{
+	resource_content *entry = pack_entries + index;
+	LOGD("add index entry(%s)...", path);
+	memset(entry, 0, sizeof(*entry));
+	snprintf(entry->path, sizeof(entry->path), "%s", path);
+	entry->content_offset = offset;
+	entry->content_size = size;
+	entry->orig_size = size;
+	entry->comp = RESOURCE_COMP_NONE;
+	return true;
+}
+
+static bool write_index_v0(void)
+{
+	LOGD("try to write index table(v0)...");
+	index_tbl_entry entry;
+	int i;
+	for (i = 0; i < header.tbl_entry_num; i++) {
+		resource_content *content = pack_entries + i;
+		if (content->content_offset > UINT32_MAX ||
+		    content->content_size > UINT32_MAX) {
+			LOGE("Too large for a v0 image:%s, try " OPT_FORMAT "1",
+			     content->path);
+			return false;
+		}
+		memset(&entry, 0, sizeof(entry));
+		memcpy(entry.tag, INDEX_TBL_ENTR_TAG, sizeof(entry.tag));
+		snprintf(entry.path, sizeof(entry.path), "%s", content->path);
+		entry.content_offset = content->content_offset;
+		entry.content_size = content->content_size;
+
+		/* switch for le. */
+		fix_entry(&entry);
+		if (!write_data(header.header_size + i * header.tbl_entry_size,
+		                &entry, sizeof(entry)))
+			return false;
+	}
+	return true;
+}
+
+/* checksums of a written entry, read back from the image. */
+static bool csum_entry(resource_content *content)
+{
+	char buf[BLOCK_SIZE * 64];
+	uint64_t offset = content->content_offset;
+	uint64_t len = content->content_size;
+	content_csum csum;
+
+	csum_begin(&csum, header.flags);
+	while (len > 0) {
+		int blocks = fix_blocks(len);
+		size_t n;
+		if (blocks > sizeof(buf) / BLOCK_SIZE)
+			blocks = sizeof(buf) / BLOCK_SIZE;
+		if (!StorageReadLba(offset, buf, blocks)) {
+			LOGE("Failed to read back:%s", content->path);
+			return false;
+		}
+		n = len < sizeof(buf) ? len : sizeof(buf);
+		csum_update(&csum, buf, n);
+		offset += blocks;
+		len -= n;
+	}
+	csum_end(&csum, content);
+	return true;
+}
+
+static int cmp_entry_v1(const void *a, const void *b)
+{
+	const resource_content *ea = (const resource_content *)a;
+	const resource_content *eb = (const resource_content *)b;
+	uint32_t ha = path_hash(ea->path);
+	uint32_t hb = path_hash(eb->path);
+
+	if (ha != hb)
+		return ha < hb ? -1 : 1;
+	return strcmp(ea->path, eb->path);
+}
+
+/* writes the v1 index table at offset_block, after the contents. */
+static bool write_index_v1(uint64_t offset_block)
+{
+	LOGD("try to write index table(v1)...");
+	int num = header.tbl_entry_num;
+	uint32_t tbl_size = num * header.entry_size;
+	uint32_t path_offset;
+	bool ret = false;
+	char *tbl = NULL;
+	int i;
+
+	for (i = 0; i < num; i++) {
+		if (!csum_entry(pack_entries + i))
+			goto end;
+		tbl_size += strlen(pack_entries[i].path) + 1;
+	}
+	qsort(pack_entries, num, sizeof(*pack_entries), cmp_entry_v1);
+
+	tbl = (char *)calloc(1, tbl_size);
+	if (!tbl)
+		goto end;
+	path_offset = num * header.entry_size;
+	for (i = 0; i < num; i++) {
+		resource_content *content = pack_entries + i;
+		index_tbl_entry_v1 entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.path_hash = path_hash(content->path);
+		entry.path_offset = path_offset;
+		entry.content_offset = content->content_offset * BLOCK_SIZE;
+		entry.content_size = content->content_size;
+		entry.orig_size = content->orig_size;
+		entry.flags = content->comp;
+		entry.crc32 = content->crc32;
+		memcpy(entry.sha256, content->sha256, sizeof(entry.sha256));
+		strcpy(tbl + path_offset, content->path);
+		path_offset += strlen(content->path) + 1;
+
+		/* switch for le. */
+		fix_entry_v1(&entry);
+		memcpy(tbl + i * header.entry_size, &entry, sizeof(entry));
+	}
+
+	header.tbl_size = tbl_size;
+	header.tbl_offset_v1 = offset_block * BLOCK_SIZE;
+	header.tbl_crc = crc32_update(0, tbl, tbl_size);
+	ret = write_data(offset_block, tbl, tbl_size);
+end:
+	free(tbl);
+	return ret;
+}
+
+/************charge anim compile****************/
+
+typedef struct {
+	int first; /* index of the level's first frame in files. */
+	int num;
+} anim_atlas;
+
+static anim_atlas *atlases = NULL;
+static int atlas_num = 0;
+static void *charge_desc_data = NULL;
+static size_t charge_desc_size = 0;
+
+static int find_file(int file_num, const char **files, const char *path)
+{
+	int i;
+	for (i = 0; i < file_num; i++) {
+		if (!strcmp(get_entry_path(files[i]), path))
+			return i;
+	}
+	return -1;
+}
+
+static int find_frame(int file_num, const char **files,
+                      anim_level_conf *conf, int j)
+{
+	char path[MAX_INDEX_ENTRY_PATH_LEN + 16];
+	int i;
+	if (conf->num == 1) {
+		snprintf(path, sizeof(path), "%s" CHARGE_FRAME_SUBFIX, conf->prefix);
+		i = find_file(file_num, files, path);
+		if (i >= 0)
+			return i;
+	}
+	snprintf(path, sizeof(path), "%s%d" CHARGE_FRAME_SUBFIX, conf->prefix, j);
+	i = find_file(file_num, files, path);
+	if (i < 0)
+		LOGE("Missing anim frame:%s", path);
+	return i;
+}
+
+static char *read_file_data(const char *path, size_t *size)
+{
+	char *buf = NULL;
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		LOGE("Failed to open:%s", path);
+		return NULL;
+	}
+	*size = get_file_size(path);
+	buf = (char *)malloc(*size + 1);
+	if (!buf || (*size && !fread(buf, *size, 1, file))) {
+		LOGE("Failed to read:%s", path);
+		free(buf);
+		buf = NULL;
+	} else {
+		buf[*size] = '\0';
+	}
+	fclose(file);
+	return buf;
+}
+
+/*
+ * If charge_anim_desc.txt is packed, compiles it into CHARGE_DESC_BIN_PATH
+ * and moves the frames of each level to the end of files, level by level,
+ * so that write_index_tbl() lays them out as one atlas per level. The
+ * text descriptor and the frame entries are kept for older loaders.
+ *
+ * returns: number of index entries to add, 0 if nothing was compiled
+ */
+static int compile_charge_anim(int file_num, const char **files)
+{
+	anim_desc desc;
+	char *buf = NULL;
+	size_t size;
+	int *frames = NULL;
+	const char **order = NULL;
+	int total = 0;
+	int i, j, k, n;
+
+	desc.levels = NULL;
+	i = find_file(file_num, files, DEF_CHARGE_DESC_PATH);
+	if (i < 0)
+		return 0;
+	buf = read_file_data(files[i], &size);
+	if (!buf)
+		goto fail;
+	if (!parse_charge_desc(buf, buf + size, &desc)) {
+		LOGE("Failed to parse:%s", files[i]);
+		goto fail;
+	}
+
+	for (i = 0; i < desc.level_num; i++)
+		total += desc.levels[i].num;
+	frames = (int *)malloc(total * sizeof(int));
+	order = (const char **)malloc(file_num * sizeof(char *));
+	atlases = (anim_atlas *)malloc(desc.level_num * sizeof(anim_atlas));
+	if (!frames || !order || !atlases)
+		goto fail;
+
+	n = 0;
+	for (i = 0; i < desc.level_num; i++) {
+		atlases[i].first = file_num - total + n;
+		atlases[i].num = desc.levels[i].num;
+		for (j = 0; j < desc.levels[i].num; j++) {
+			frames[n] = find_frame(file_num, files, &desc.levels[i], j);
+			if (frames[n] < 0)
+				goto fail;
+			for (k = 0; k < n; k++) {
+				if (frames[k] == frames[n]) {
+					LOGE("Anim frame in two levels:%s", files[frames[n]]);
+					goto fail;
+				}
+			}
+			n++;
+		}
+	}
+
+	/* other files keep their order, frames follow level by level. */
+	n = 0;
+	for (i = 0; i < file_num; i++) {
+		for (k = 0; k < total; k++) {
+			if (frames[k] == i)
+				break;
+		}
+		if (k == total)
+			order[n++] = files[i];
+	}
+	for (k = 0; k < total; k++)
+		order[n++] = files[frames[k]];
+	memcpy(files, order, file_num * sizeof(char *));
+
+	charge_desc_size =
+	        sizeof(charge_desc_bin) + desc.level_num * sizeof(charge_level_bin);
+	charge_desc_data = calloc(1, charge_desc_size);
+	if (!charge_desc_data)
+		goto fail;
+	charge_desc_bin *hdr = (charge_desc_bin *)charge_desc_data;
+	charge_level_bin *levels = (charge_level_bin *)(hdr + 1);
+	memcpy(hdr->magic, CHARGE_DESC_BIN_MAGIC, sizeof(hdr->magic));
+	hdr->version = switch_int(CHARGE_DESC_BIN_VERSION);
+	hdr->delay = switch_int(desc.delay);
+	hdr->only_current_level = switch_int(desc.only_current_level);
+	hdr->level_num = switch_int(desc.level_num);
+	for (i = 0; i < desc.level_num; i++) {
+		levels[i].max_level = switch_int(desc.levels[i].max_level);
+		levels[i].num = switch_int(desc.levels[i].num);
+		levels[i].delay = switch_int(desc.levels[i].delay);
+	}
+	atlas_num = desc.level_num;
+
+	LOGD("compiled %s: %d levels, %d frames", DEF_CHARGE_DESC_PATH,
+	     atlas_num, total);
+	free(desc.levels);
+	free(order);
+	free(frames);
+	free(buf);
+	return 1 + atlas_num;
+fail:
+	LOGE("Not compiling %s, packed as is.", DEF_CHARGE_DESC_PATH);
+	free(desc.levels);
+	free(order);
+	free(frames);
+	free(buf);
+	free(atlases);
+	atlases = NULL;
+	return 0;
+}
+
+/*
+ * Writes the atlas header of level a at offset_block, in front of the
+ * level's frames, and its index entry.
+ *
+ * returns: blocks used by the header, -1 on error
+ */
+static int write_atlas(int a, uint64_t offset_block, const int file_num,
+                       const char **files)
+{
+	int num = atlases[a].num;
+	size_t hdr_size =
+	        sizeof(charge_atlas_header) + num * sizeof(charge_atlas_frame);
+	int hdr_blocks = fix_blocks(hdr_size);
+	char path[MAX_INDEX_ENTRY_PATH_LEN];
+	int ret = -1;
+	int j;
+
+	charge_atlas_header *hdr = (charge_atlas_header *)calloc(1, hdr_size);
+	if (!hdr)
+		return -1;
+	charge_atlas_frame *frames = (charge_atlas_frame *)(hdr + 1);
+	memcpy(hdr->magic, CHARGE_ATLAS_MAGIC, sizeof(hdr->magic));
+	hdr->frame_num = switch_int(num);
+
+	uint32_t offset = hdr_blocks * BLOCK_SIZE;
+	uint32_t size = 0;
+	for (j = 0; j < num; j++) {
+		size = get_file_size(files[atlases[a].first + j]);
+		frames[j].offset = switch_int(offset);
+		frames[j].size = switch_int(size);
+		offset += fix_blocks(size) * BLOCK_SIZE;
+	}
+	/* the last frame is not padded. */
+	size = offset - fix_blocks(size) * BLOCK_SIZE + size;
+
+	if (!write_data(offset_block, hdr, hdr_size))
+		goto end;
+	snprintf(path, sizeof(path), CHARGE_ATLAS_PATH, a);
+	if (!write_entry(file_num + 1 + a, path, offset_block, size))
+		goto end;
+	ret = hdr_blocks;
+end:
+	free(hdr);
+	return ret;
+}
+
+/************charge anim compile end****************/
+
+/************content dedup****************/
+
+/*
+ * Contents already in the image: a file identical to one of them gets an
+ * entry pointing at the existing content instead of a copy.
+ */
+typedef struct {
+	uint8_t sha256[SHA256_DIGEST_SIZE];
+	uint64_t size;           /* bytes. */
+	uint64_t content_offset; /* blocks. */
+	uint64_t content_size;   /* bytes, as stored. */
+	uint32_t comp;           /* RESOURCE_COMP_*. */
+} packed_content;
+
+static packed_content *packed = NULL;
+static int packed_num = 0;
+static int dedup_num = 0;
+static uint64_t dedup_saved = 0;
+
+static bool hash_file(const char *path, uint8_t *sha)
+{
+	char buf[BLOCK_SIZE * 64];
+	content_csum csum;
+	resource_content sum;
+	size_t n;
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		LOGE("Failed to open:%s", path);
+		return false;
+	}
+	csum_begin(&csum, RESOURCE_FLAG_SHA256);
+	while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+		csum_update(&csum, buf, n);
+	fclose(file);
+	csum_end(&csum, &sum);
+	memcpy(sha, sum.sha256, SHA256_DIGEST_SIZE);
+	return true;
+}
+
+/* returns: the packed content identical to sha/size, NULL if none. */
+static packed_content *find_packed(const uint8_t *sha, uint64_t size)
+{
+	int i;
+	for (i = 0; i < packed_num; i++) {
+		if (packed[i].size == size &&
+		    !memcmp(packed[i].sha256, sha, SHA256_DIGEST_SIZE))
+			return packed + i;
+	}
+	return NULL;
+}
+
+static void add_packed(const uint8_t *sha, uint64_t size,
+                       resource_content *entry)
+{
+	packed_content *p = packed + packed_num++;
+	memcpy(p->sha256, sha, SHA256_DIGEST_SIZE);
+	p->size = size;
+	p->content_offset = entry->content_offset;
+	p->content_size = entry->content_size;
+	p->comp = entry->comp;
+}
+
+/************content dedup end****************/
+/************compress code****************/
+
+static uint64_t comp_in = 0;
+static uint64_t comp_out = 0;
+
+/*
+ * Writes src_path compressed with pack_comp if that makes it smaller,
+ * and records how it is stored in entry.
+ *
+ * returns: blocks written, -1 on error
+ */
+static int write_file_comp(uint64_t offset_block, const char *src_path,
+                           resource_content *entry)
+{
+	size_t size;
+	uint8_t *data = (uint8_t *)read_file_data(src_path, &size);
+	uint8_t *out = NULL;
+	size_t out_len = 0;
+	int ret = -1;
+	if (!data)
+		return -1;
+
+	switch (pack_comp) {
+	case RESOURCE_COMP_LZ4:
+		out = lz4_compress(data, size, &out_len);
+		break;
+#ifdef HAVE_ZSTD
+	case RESOURCE_COMP_ZSTD:
+		out_len = ZSTD_compressBound(size);
+		out = (uint8_t *)malloc(out_len);
+		if (out) {
+			out_len = ZSTD_compress(out, out_len, data, size, 19);
+			if (ZSTD_isError(out_len)) {
+				LOGE("Failed to compress %s(%s)", src_path,
+				     ZSTD_getErrorName(out_len));
+				goto end;
+			}
+		}
+		break;
+#endif
+	}
+	if (!out)
+		goto end;
+
+	entry->orig_size = size;
+	if (fix_blocks(out_len) < fix_blocks(size)) {
+		LOGD("%s: %zu -> %zu bytes(%s)", src_path, size, out_len,
+		     comp_name(pack_comp));
+		if (!write_data(offset_block, out, out_len))
+			goto end;
+		entry->content_size = out_len;
+		entry->comp = pack_comp;
+	} else {
+		/* not worth it, e.g. already compressed. */
+		if (size && !write_data(offset_block, data, size))
+			goto end;
+		entry->content_size = size;
+		entry->comp = RESOURCE_COMP_NONE;
+	}
+	comp_in += size;
+	comp_out += entry->content_size;
+	ret = fix_blocks(entry->content_size);
+end:
+	free(out);
+	free(data);
+	return ret;
+}
+
+/************compress code end****************/
+
 static bool write_index_tbl(const int file_num, const char **files)
 {
 	LOGD("try to write index table...");
 	bool ret = false;
 	bool foundFdt = false;
-	int offset =
-	        header.header_size + header.tbl_entry_size * header.tbl_entry_num;
-	index_tbl_entry entry;
-	memcpy(entry.tag, INDEX_TBL_ENTR_TAG, sizeof(entry.tag));
-	int i;
+	uint64_t offset = header.header_size;
+	if (header.resource_ptn_version == RESOURCE_PTN_VERSION)
+		offset += header.tbl_entry_size * header.tbl_entry_num;
+	int i, a;
 	for (i = 0; i < file_num; i++) {
+		bool in_atlas = false;
+		for (a = 0; a < atlas_num; a++) {
+			if (atlases[a].first == i) {
+				offset = align_blocks(offset);
+				int blocks = write_atlas(a, offset, file_num, files);
+				if (blocks < 0)
+					goto end;
+				offset += blocks;
+			}
+			if (i >= atlases[a].first && i < atlases[a].first + atlases[a].num)
+				in_atlas = true;
+		}
 		size_t file_size = get_file_size(files[i]);
 		if (file_size < 0)
 			goto end;
-		entry.content_size = file_size;
-		entry.content_offset = offset;
 
-		if (write_file(offset, files[i]) < 0)
+		uint8_t sha[SHA256_DIGEST_SIZE];
+		if (!hash_file(files[i], sha))
 			goto end;
-
-		LOGD("try to write index entry(%s)...", files[i]);
-
-		/* switch for le. */
-		fix_entry(&entry);
-		memset(entry.path, 0, sizeof(entry.path));
-		const char *path = files[i];
-		if (root_path[0]) {
-			if (!strncmp(path, root_path, strlen(root_path))) {
-				path += strlen(root_path);
-				if (path[0] == '/')
-					path++;
-			}
+		/* frames must be stored in their atlas, even if not new. */
+		packed_content *same = in_atlas ? NULL : find_packed(sha, file_size);
+		resource_content stored;
+		stored.content_size = stored.orig_size = file_size;
+		stored.comp = RESOURCE_COMP_NONE;
+		if (same) {
+			LOGD("%s: same content as offset %llu", files[i],
+			     (unsigned long long)same->content_offset);
+			stored.content_offset = same->content_offset;
+			stored.content_size = same->content_size;
+			stored.comp = same->comp;
+			dedup_num++;
+			dedup_saved += fix_blocks(same->content_size) * BLOCK_SIZE;
+		} else {
+			int blocks;
+			/* frames stay packed as laid out in their atlas. */
+			if (!in_atlas)
+				offset = align_blocks(offset);
+			stored.content_offset = offset;
+			if (in_atlas || pack_comp == RESOURCE_COMP_NONE)
+				blocks = write_file(offset, files[i]);
+			else
+				blocks = write_file_comp(offset, files[i], &stored);
+			if (blocks < 0)
+				goto end;
+			add_packed(sha, file_size, &stored);
+			offset += blocks;
 		}
-		path = fix_path(path);
+
+		const char *path = get_entry_path(files[i]);
 		if (!strcmp(files[i] + strlen(files[i]) - strlen(DTD_SUBFIX), DTD_SUBFIX)) {
 			if (!foundFdt) {
 				/* use default path. */
@@ -951,13 +2730,26 @@ static bool write_index_tbl(const int file_num, const char **files)
 				foundFdt = true;
 			}
 		}
-		snprintf(entry.path, sizeof(entry.path), "%s", path);
-		offset += fix_blocks(file_size);
-		if (!write_data(header.header_size + i * header.tbl_entry_size, &entry,
-		                sizeof(entry)))
+		if (!write_entry(i, path, stored.content_offset, file_size))
 			goto end;
+		pack_entries[i].content_size = stored.content_size;
+		pack_entries[i].comp = stored.comp;
 	}
-	ret = true;
+
+	if (charge_desc_data) {
+		offset = align_blocks(offset);
+		if (!write_data(offset, charge_desc_data, charge_desc_size))
+			goto end;
+		if (!write_entry(file_num, CHARGE_DESC_BIN_PATH, offset,
+		                 charge_desc_size))
+			goto end;
+		offset += fix_blocks(charge_desc_size);
+	}
+
+	if (header.resource_ptn_version == RESOURCE_PTN_VERSION)
+		ret = write_index_v0();
+	else
+		ret = write_index_v1(offset);
 end:
 	return ret;
 }
@@ -965,6 +2757,11 @@ end:
 static int pack_image(int file_num, const char **files)
 {
 	bool ret = false;
+	if (pack_comp != RESOURCE_COMP_NONE &&
+	    pack_version == RESOURCE_PTN_VERSION) {
+		LOGE("Compression needs " OPT_FORMAT "1!");
+		goto end;
+	}
 	FILE *image_file = fopen(image_path, "wb");
 	if (!image_file) {
 		LOGE("Failed to create:%s", image_path);
@@ -992,14 +2789,28 @@ static int pack_image(int file_num, const char **files)
 		}
 	}
 
-	if (!write_header(file_num)) {
-		LOGE("Failed to write header!");
+	int extra = compile_charge_anim(file_num, files);
+
+	init_header(file_num + extra);
+	pack_entries = (resource_content *)calloc(file_num + extra,
+	                                          sizeof(*pack_entries));
+	packed = (packed_content *)calloc(file_num, sizeof(*packed));
+	if (!pack_entries || !packed)
 		goto end;
-	}
 	if (!write_index_tbl(file_num, files)) {
 		LOGE("Failed to write index table!");
 		goto end;
 	}
+	if (!write_header()) {
+		LOGE("Failed to write header!");
+		goto end;
+	}
+	if (dedup_num)
+		printf("Dedup: %d entries share content, %llu bytes saved.\n",
+		       dedup_num, (unsigned long long)dedup_saved);
+	if (comp_in)
+		printf("Compress(%s): %llu -> %llu bytes.\n", comp_name(pack_comp),
+		       (unsigned long long)comp_in, (unsigned long long)comp_out);
 	printf("Pack to %s successed!\n", image_path);
 	ret = true;
 end:
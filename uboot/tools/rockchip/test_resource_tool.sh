@@ -0,0 +1,68 @@
+#!/bin/bash
+#
+# Round-trip test for resource_tool: packs files of odd lengths in every
+# format/compression/checksum combination, unpacks them again and compares
+# the contents. SHA-256 digests stored in v1 images are also compared with
+# sha256sum of the stored (possibly compressed) content.
+#
+# usage: test_resource_tool.sh [path/to/resource_tool]
+#
+
+TOOL=$(readlink -f ${1:-./resource_tool})
+TMP=$(mktemp -d)
+trap "rm -rf $TMP" EXIT
+FAILED=0
+
+fail()
+{
+	echo "FAIL: $*"
+	FAILED=1
+}
+
+cd $TMP
+mkdir in
+# "abcd" + 3000 x 'x': odd length, compresses to an odd length as well
+(printf abcd; head -c 3000 /dev/zero | tr '\0' x) > in/k.dtb
+for len in 1 3 63 64 65 511 513 4093; do
+	head -c $len /dev/urandom > in/r$len.bin
+done
+
+COMPRESS="none lz4"
+$TOOL --help 2>&1 | grep -q zstd && COMPRESS="$COMPRESS zstd"
+
+check()
+{
+	local opts="$*"
+	local f off size digest
+
+	rm -rf out res.img
+	(cd in && $TOOL --pack $opts --image=../res.img * > /dev/null) ||
+		{ fail "pack $opts"; return; }
+	$TOOL --unpack --image=res.img out > log 2>&1 ||
+		{ fail "unpack $opts"; cat log; return; }
+	# the first dtb is packed as rk-kernel.dtb
+	cmp -s in/k.dtb out/rk-kernel.dtb || fail "k.dtb $opts"
+	for f in in/r*.bin; do
+		cmp -s $f out/${f#in/} || fail "${f#in/} $opts"
+	done
+	# entries are printed as "offset:<blocks>\tsize:<bytes>", then
+	# "<compression>:<stored bytes>" and "sha256:<digest>" when present
+	while read off size digest; do
+		[ "$(dd if=res.img bs=512 skip=$off 2> /dev/null | head -c $size |
+			sha256sum | cut -d' ' -f1)" = "$digest" ] ||
+			fail "non-standard sha256 at block $off $opts"
+	done < <(awk -F'[:\t]' '
+		$2 == "offset" { off = $3; size = $5 }
+		$2 ~ /^(lz4|zstd)$/ { size = $3 }
+		$2 == "sha256" { print off, size, $3 }' log)
+}
+
+check --format=0
+for comp in $COMPRESS; do
+	for sum in none crc32 sha256; do
+		check --format=1 --compress=$comp --checksum=$sum
+	done
+done
+
+[ $FAILED = 0 ] && echo "PASS"
+exit $FAILED